@@ -2,47 +2,476 @@
 
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define HOST_APP_SSE
+#include <immintrin.h>
+#endif
+
+// GCC and Clang can compile a function for AVX without the rest of the executable requiring it
+#if defined(HOST_APP_SSE) && defined(__GNUC__)
+#define HOST_APP_AVX
+#endif
+
+ObjectStore g_objects;
+
+ObjectChunk* Object::find(size_t& index) const {
+    auto chunk = m_slot / ObjectChunk::capacity;
+    index      = m_slot % ObjectChunk::capacity;
+    if(chunk >= g_objects.chunks.size())
+        return nullptr;
+    auto& objects = *g_objects.chunks[chunk];
+    return index < objects.used && objects.alive[index] && objects.generation[index] == m_generation ? &objects : nullptr;
+}
+
+bool Object::alive() const {
+    size_t index;
+    return find(index) != nullptr;
+}
+
 void Object::translate(float x, float y) {
-    m_x = x;
-    m_y = y;
+    size_t index;
+    if(auto chunk = find(index)) {
+        chunk->x[index] = x;
+        chunk->y[index] = y;
+    }
 }
 
 void Object::colorize(float r, float g, float b) {
-    m_r = r;
-    m_g = g;
-    m_b = b;
+    size_t index;
+    if(auto chunk = find(index)) {
+        chunk->r[index] = r;
+        chunk->g[index] = g;
+        chunk->b[index] = b;
+    }
 }
 
-void Object::set_speed(float speed) { m_rot_speed = speed; }
+void Object::set_speed(float speed) {
+    size_t index;
+    if(auto chunk = find(index))
+        chunk->rot_speed[index] = speed;
+}
 
-void Object::draw() {
-    m_rot += m_rot_speed;
+ObjectStore& getObjectStore() { return g_objects; }
 
-    glPushMatrix();
+std::vector<Object> getObjects() {
+    std::vector<Object> out;
+    out.reserve(g_objects.count);
+    for(size_t c = 0; c < g_objects.chunks.size(); ++c) {
+        const auto& chunk = *g_objects.chunks[c];
+        for(size_t i = 0; i < chunk.used; ++i)
+            if(chunk.alive[i])
+                out.push_back(Object(uint32_t(c * ObjectChunk::capacity + i), chunk.generation[i]));
+    }
+    return out;
+}
+
+Object addObject(float x, float y) {
+    // a hole left by a removed object - or the next slot of the last chunk (which might be a new one)
+    uint32_t slot;
+    if(g_objects.free_slots.size()) {
+        slot = g_objects.free_slots.back();
+        g_objects.free_slots.pop_back();
+    } else {
+        if(g_objects.chunks.empty() || g_objects.chunks.back()->used == ObjectChunk::capacity)
+            g_objects.chunks.emplace_back(new ObjectChunk());
+        auto& last                 = *g_objects.chunks.back();
+        last.generation[last.used] = 0;
+        slot                       = uint32_t((g_objects.chunks.size() - 1) * ObjectChunk::capacity + last.used++);
+    }
 
-    glTranslatef(m_x, m_y, 0);
-    glRotatef(m_rot, 0, 0, 1);
+    auto&  chunk = *g_objects.chunks[slot / ObjectChunk::capacity];
+    size_t index = slot % ObjectChunk::capacity;
+
+    chunk.x[index]         = x;
+    chunk.y[index]         = y;
+    chunk.r[index]         = 0.3f;
+    chunk.g[index]         = 0.3f;
+    chunk.b[index]         = 0.3f;
+    chunk.rot[index]       = 0;
+    chunk.rot_speed[index] = 1.f;
+    chunk.alive[index]     = true;
+    chunk.count++;
+    g_objects.count++;
+    return Object(slot, chunk.generation[index]);
+}
 
-    glBegin(GL_QUADS);
+void removeObject(Object obj) {
+    size_t index;
+    auto   chunk = obj.find(index);
+    if(!chunk)
+        return;
 
-    glColor3f(m_r, m_g, m_b);
+    chunk->alive[index]     = false;
+    chunk->rot_speed[index] = 0;
+    chunk->generation[index]++;
+    chunk->count--;
+    g_objects.count--;
+    g_objects.free_slots.push_back(obj.m_slot);
+}
 
-    glVertex2f(-1, -1);
-    glVertex2f(-1, 1);
-    glVertex2f(1, 1);
-    glVertex2f(1, -1);
+void addDemoScene() {
+    for(int i = 0; i < 4; ++i) {
+        for(int k = 0; k < 4; ++k) {
+            auto obj = addObject(-7.5f + k * 5, -4.5f + i * 3);
+            obj.colorize(float(i % 2), float(k % 2), 0);
+            obj.set_speed(0);
+        }
+    }
+}
 
-    glEnd();
+bool objectsMoving() {
+    for(const auto& chunk : g_objects.chunks)
+        for(size_t i = 0; i < chunk->used; ++i)
+            if(chunk->rot_speed[i] != 0)
+                return true;
+    return false;
+}
 
-    glPopMatrix();
+// rot[i] += speed[i] for the elements from 'begin' - returns where it stopped (the rest doesn't fill a register)
+static size_t update_sse(float* rot, const float* speed, size_t begin, size_t count) {
+    size_t i = begin;
+#ifdef HOST_APP_SSE
+    for(; i + 4 <= count; i += 4)
+        _mm_storeu_ps(rot + i, _mm_add_ps(_mm_loadu_ps(rot + i), _mm_loadu_ps(speed + i)));
+#endif
+    return i;
 }
 
-std::vector<Object> g_objects;
+#ifdef HOST_APP_AVX
+__attribute__((target("avx"))) static size_t update_avx(float* rot, const float* speed, size_t count) {
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(rot + i, _mm256_add_ps(_mm256_loadu_ps(rot + i), _mm256_loadu_ps(speed + i)));
+    return i;
+}
+#endif
+
+void updateObjects() {
+#ifdef HOST_APP_AVX
+    static const bool has_avx = __builtin_cpu_supports("avx");
+#endif
+    // the holes in the chunks are updated as well - with a speed of 0 - so there are no branches
+    for(auto& chunk : g_objects.chunks) {
+        size_t i = 0;
+#ifdef HOST_APP_AVX
+        if(has_avx)
+            i = update_avx(chunk->rot, chunk->rot_speed, chunk->used);
+#endif
+        i = update_sse(chunk->rot, chunk->rot_speed, i, chunk->used);
+        for(; i < chunk->used; ++i)
+            chunk->rot[i] += chunk->rot_speed[i];
+    }
+}
+
+// a vertex of the quads of all objects - interleaved for the vertex arrays
+struct ObjectVertex
+{
+    float x, y;
+    float r, g, b;
+};
+
+// rebuilt every frame - kept so its memory is reused
+static std::vector<ObjectVertex> g_vertices;
+// where the vertices of the objects from each chunk begin
+static std::vector<size_t> g_chunk_vertices;
+
+// the 4 vertices of each of the objects in the range of chunks - transformed on the CPU instead of through the matrix stack
+static void build_vertices(size_t begin, size_t end) {
+    static const float corners[4][2] = {{-1, -1}, {-1, 1}, {1, 1}, {1, -1}};
+    for(size_t c = begin; c < end; ++c) {
+        const auto& chunk  = *g_objects.chunks[c];
+        auto        vertex = g_vertices.begin() + g_chunk_vertices[c];
+        for(size_t i = 0; i < chunk.used; ++i) {
+            if(!chunk.alive[i])
+                continue;
+            // the rotation is in degrees - as it was for glRotatef()
+            float angle = chunk.rot[i] * 0.017453292f;
+            float cos   = std::cos(angle);
+            float sin   = std::sin(angle);
+            for(int k = 0; k < 4; ++k, ++vertex) {
+                vertex->x = chunk.x[i] + corners[k][0] * cos - corners[k][1] * sin;
+                vertex->y = chunk.y[i] + corners[k][0] * sin + corners[k][1] * cos;
+                vertex->r = chunk.r[i];
+                vertex->g = chunk.g[i];
+                vertex->b = chunk.b[i];
+            }
+        }
+    }
+}
+
+void drawObjects() {
+    if(g_objects.count == 0)
+        return;
+    g_vertices.resize(g_objects.count * 4);
+    g_chunk_vertices.resize(g_objects.chunks.size());
+    for(size_t c = 0, offset = 0; c < g_objects.chunks.size(); offset += g_objects.chunks[c++]->count * 4)
+        g_chunk_vertices[c] = offset;
+
+    // split between the job threads by chunks - a scene which fits in a single chunk is built by this thread alone
+    parallelFor(0, g_objects.chunks.size(), build_vertices, 1);
+
+    // a single draw call with client side vertex arrays (OpenGL 1.1) - supported by Mesa's software renderers as well
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(ObjectVertex), &g_vertices[0].x);
+    glColorPointer(3, GL_FLOAT, sizeof(ObjectVertex), &g_vertices[0].r);
+    glDrawArrays(GL_QUADS, 0, GLsizei(g_vertices.size()));
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+// a job from submitJob() - kept alive by the handles to it and by the queues until it has been run
+struct JobState
+{
+    std::function<void()>                  work;
+    std::exception_ptr                     exception;
+    std::atomic<int>                       pending{1}; // dependencies which aren't done - and 1 until it is submitted
+    std::atomic<bool>                      done{false};
+    std::mutex                             mutex; // for setting 'done' and for the dependents
+    std::vector<std::shared_ptr<JobState>> dependents;
+};
+
+// the jobs queued by a thread - it takes them from the back (the most recent ones) and the other threads steal from the
+// front (the oldest ones - which are more likely to be split into more jobs)
+struct JobQueue
+{
+    std::mutex                            mutex;
+    std::deque<std::shared_ptr<JobState>> jobs;
+};
+
+// the job threads and their queues - the first queue is for the threads which aren't job threads (the main thread)
+struct JobSystem
+{
+    std::vector<std::unique_ptr<JobQueue>> queues;
+    std::vector<std::thread>               threads;
+    std::atomic<size_t>                    queued{0};
+    std::atomic<size_t>                    unfinished{0}; // submitted but not done - including the waiting for others
+    std::mutex                             mutex;         // for sleeping on the condition variables
+    std::condition_variable                work_queued;
+    std::condition_variable                job_done;      // or queued - for the threads waiting in run_jobs_until()
+    bool                                   stopping = false;
+
+    JobSystem();
+    ~JobSystem();
+
+    void start_threads();
+    // lets the threads finish the queued jobs and joins them
+    void stop_threads();
+};
+
+// the queue of the current thread
+static thread_local size_t t_queue = 0;
 
-std::vector<Object>& getObjects() { return g_objects; }
+// started with the first job - a thread for each core except the one of the main thread
+static JobSystem& get_jobs() {
+    static JobSystem jobs;
+    return jobs;
+}
+
+static void enqueue(JobSystem& jobs, std::shared_ptr<JobState> job) {
+    auto& queue = *jobs.queues[t_queue];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    jobs.queued++;
+    std::lock_guard<std::mutex> lock(jobs.mutex);
+    jobs.work_queued.notify_one();
+    // a thread waiting for a job to be done helps with the new one instead of sleeping until some job is done
+    jobs.job_done.notify_all();
+}
+
+// from the back of the queue of the current thread or from the front of one of the others
+static std::shared_ptr<JobState> take_job(JobSystem& jobs) {
+    for(size_t i = 0; i < jobs.queues.size() && jobs.queued; ++i) {
+        auto&                       queue = *jobs.queues[(t_queue + i) % jobs.queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(queue.jobs.empty())
+            continue;
+        std::shared_ptr<JobState> job;
+        if(i == 0) {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        } else {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+        }
+        jobs.queued--;
+        return job;
+    }
+    return nullptr;
+}
+
+static void run_job(JobSystem& jobs, const std::shared_ptr<JobState>& job) {
+    try {
+        job->work();
+    } catch(...) { job->exception = std::current_exception(); }
+    // the captures might have been created by the code of a plugin - so they are destroyed before it can be unloaded
+    job->work = nullptr;
+
+    std::vector<std::shared_ptr<JobState>> dependents;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done = true;
+        dependents.swap(job->dependents);
+    }
+    for(auto& dependent : dependents)
+        if(--dependent->pending == 0)
+            enqueue(jobs, std::move(dependent));
+
+    std::lock_guard<std::mutex> lock(jobs.mutex);
+    jobs.unfinished--;
+    jobs.job_done.notify_all();
+}
+
+// runs jobs while waiting for something which other jobs will lead to
+static void run_jobs_until(JobSystem& jobs, const std::function<bool()>& finished) {
+    while(!finished()) {
+        if(auto job = take_job(jobs)) {
+            run_job(jobs, job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(jobs.mutex);
+        jobs.job_done.wait(lock, [&]() { return finished() || jobs.queued; });
+    }
+}
+
+JobSystem::JobSystem() {
+    unsigned num_threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    for(unsigned i = 0; i <= num_threads; ++i)
+        queues.emplace_back(new JobQueue());
+    start_threads();
+}
+
+JobSystem::~JobSystem() { stop_threads(); }
+
+void JobSystem::start_threads() {
+    stopping = false;
+    for(size_t i = 1; i < queues.size(); ++i) {
+        threads.emplace_back([this, i]() {
+            t_queue = i;
+            for(;;) {
+                if(auto job = take_job(*this)) {
+                    run_job(*this, job);
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                work_queued.wait(lock, [&]() { return queued || stopping; });
+                if(stopping && !queued)
+                    return;
+            }
+        });
+    }
+}
+
+void JobSystem::stop_threads() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        work_queued.notify_all();
+    }
+    for(auto& thread : threads)
+        thread.join();
+    threads.clear();
+}
+
+bool Job::done() const { return !m_state || m_state->done; }
+
+void Job::wait() const {
+    if(!m_state)
+        return;
+    run_jobs_until(get_jobs(), [&]() { return bool(m_state->done); });
+    if(m_state->exception)
+        std::rethrow_exception(m_state->exception);
+}
+
+Job submitJob(std::function<void()> work, const std::vector<Job>& dependencies) {
+    auto& jobs = get_jobs();
+    Job   job;
+    job.m_state       = std::make_shared<JobState>();
+    job.m_state->work = std::move(work);
+    jobs.unfinished++;
+
+    // the last of the dependencies to finish queues the job
+    for(const auto& dependency : dependencies) {
+        if(!dependency.m_state)
+            continue;
+        std::lock_guard<std::mutex> lock(dependency.m_state->mutex);
+        if(!dependency.m_state->done) {
+            job.m_state->pending++;
+            dependency.m_state->dependents.push_back(job.m_state);
+        }
+    }
+    if(--job.m_state->pending == 0)
+        enqueue(jobs, job.m_state);
+    return job;
+}
+
+void parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body, size_t grain) {
+    if(begin >= end)
+        return;
+    auto&  jobs        = get_jobs();
+    size_t num_threads = jobs.threads.size() + 1;
+    // a few ranges per thread so the threads which finish first take more of them
+    if(grain == 0)
+        grain = std::max<size_t>(1, (end - begin + num_threads * 4 - 1) / (num_threads * 4));
+    size_t num_ranges = (end - begin + grain - 1) / grain;
+    if(num_ranges == 1) {
+        body(begin, end);
+        return;
+    }
+
+    // the ranges are taken in order by the calling thread and by as many jobs as there are other threads which can help
+    std::atomic<size_t> next(0);
+    std::exception_ptr  exception;
+    std::mutex          exception_mutex;
+    auto                run_ranges = [&]() {
+        for(size_t range; (range = next++) < num_ranges;) {
+            try {
+                body(begin + range * grain, std::min(end, begin + (range + 1) * grain));
+            } catch(...) {
+                std::lock_guard<std::mutex> lock(exception_mutex);
+                if(!exception)
+                    exception = std::current_exception();
+                next = num_ranges;
+            }
+        }
+    };
+    std::vector<Job> helpers;
+    for(size_t i = 1; i < std::min(num_threads, num_ranges); ++i)
+        helpers.push_back(submitJob(run_ranges));
+    run_ranges();
+    // the helpers which haven't started yet are run here as well - they find no ranges left
+    for(const auto& helper : helpers)
+        helper.wait();
+    if(exception)
+        std::rethrow_exception(exception);
+}
+
+void waitForJobs() {
+    assert(t_queue == 0);
+    auto& jobs = get_jobs();
+    run_jobs_until(jobs, [&]() { return jobs.unfinished == 0; });
+}
+
+unsigned getJobThreadCount() { return unsigned(get_jobs().threads.size()); }
+
+void stopJobThreads() {
+    waitForJobs();
+    get_jobs().stop_threads();
+}
 
-Object& addObject(float x, float y) {
-    g_objects.push_back(Object());
-    g_objects.back().translate(x, y);
-    return g_objects.back();
+void startJobThreads() {
+    auto& jobs = get_jobs();
+    if(jobs.threads.empty())
+        jobs.start_threads();
 }
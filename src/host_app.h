@@ -17,27 +17,132 @@
 // can also use WINDOWS_EXPORT_ALL_SYMBOLS in CMake for Windows
 // instead of explicitly annotating each symbol in the host app
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <vector>
 
+// a fixed number of objects with a contiguous array for each attribute so updating them touches only what is needed and
+// can be vectorized - removed objects leave a hole which is reused by the next added object
+struct ObjectChunk
+{
+    static const size_t capacity = 4096;
+
+    float    x[capacity], y[capacity];
+    float    r[capacity], g[capacity], b[capacity];
+    float    rot[capacity];
+    float    rot_speed[capacity];  // 0 for holes so updating them changes nothing
+    uint32_t generation[capacity]; // incremented when the object in the slot is removed
+    bool     alive[capacity];
+    size_t   used  = 0;            // slots from the start which have ever been used - the rest are uninitialized
+    size_t   count = 0;            // alive objects
+};
+
+// the attributes of all objects - chunks are never moved or freed so an object is never relocated
+struct ObjectStore
+{
+    std::vector<std::unique_ptr<ObjectChunk>> chunks;
+    std::vector<uint32_t>                     free_slots; // the holes - reused last in first out
+    size_t                                    count = 0;
+
+    size_t size() const { return count; }
+};
+
+// a handle to an object in the store - cheap to copy and keep in vars sections - the methods do nothing once the object
+// has been removed (even if its slot is reused by another object)
 class HOST_API Object
 {
-	friend HOST_API Object& addObject(float x, float y);
+	friend HOST_API std::vector<Object> getObjects();
+	friend HOST_API Object addObject(float x, float y);
+	friend HOST_API void removeObject(Object obj);
 
-    float m_x = 0, m_y = 0;
-    float m_r = 0.3f, m_g = 0.3f, m_b = 0.3f;
+    uint32_t m_slot;       // the index of the chunk * ObjectChunk::capacity + the index in the chunk
+    uint32_t m_generation; // of the slot when the object was added
 
-    float m_rot       = 0;
-    float m_rot_speed = 1.f;
+    Object(uint32_t slot, uint32_t generation)
+            : m_slot(slot)
+            , m_generation(generation) {}
 
-    Object() = default;
+    // the chunk with the object and its index there - null if the object has been removed
+    ObjectChunk* find(size_t& index) const;
 
 public:
+    bool alive() const;
     void translate(float x, float y);
     void colorize(float r, float g, float b);
     void set_speed(float speed);
+};
+
+HOST_API ObjectStore& getObjectStore();
+// handles to all objects - for(auto obj : getObjects()) obj.set_speed(2);
+HOST_API std::vector<Object> getObjects();
+HOST_API Object addObject(float x, float y);
+// O(1) - its slot goes to the free list and handles to it become stale
+HOST_API void removeObject(Object obj);
+// the 4x4 grid the demo starts with - static so the main loop can sleep until the code in the console moves something
+HOST_API void addDemoScene();
+// if any of the objects is rotating - the scene changes with every frame then
+HOST_API bool objectsMoving();
+
+// advances the rotation of all objects by their speed - with SSE (or AVX if supported by the CPU)
+HOST_API void updateObjects();
+// draws all objects with a single draw call - doesn't change them
+HOST_API void drawObjects();
+
+struct JobState;
+
+// a handle to a job from submitJob() - for waiting on it or making other jobs depend on it
+class HOST_API Job
+{
+	friend HOST_API Job submitJob(std::function<void()> work, const std::vector<Job>& dependencies);
+
+    std::shared_ptr<JobState> m_state;
+
+public:
+    bool done() const;
+    // runs other jobs while waiting - rethrows if the job has thrown
+    void wait() const;
+};
+
+// runs the work on the job threads once all of the dependencies are done (even if some of them have thrown) - a job
+// submitted from another job goes to the queue of its thread and idle threads steal from the queues of the others
+HOST_API Job submitJob(std::function<void()> work, const std::vector<Job>& dependencies = {});
+// calls the body with subranges of [begin, end) with at most 'grain' elements (0 for a split based on the number of
+// threads) on all threads - including the calling one - and returns once all are done (rethrows the first exception)
+HOST_API void parallelFor(size_t begin, size_t end, const std::function<void(size_t begin, size_t end)>& body,
+                          size_t grain = 0);
+// runs jobs until all of the submitted ones are done - the engine calls this after the code of each plugin has been
+// executed and before unloading plugins so no job outlives the code it came from - only for the main thread
+HOST_API void waitForJobs();
+// the job threads - without the main thread which runs jobs only while waiting
+HOST_API unsigned getJobThreadCount();
+// for forking the process (only the calling thread exists in the child) - stopJobThreads() waits for all jobs and joins
+// the threads and startJobThreads() creates them again - meanwhile jobs are run only by the threads waiting for them
+HOST_API void stopJobThreads();
+HOST_API void startJobThreads();
+
+// the result of a job from submitTask()
+template <typename T>
+class Future
+{
+    Job                m_job;
+    std::shared_ptr<T> m_result;
+
+public:
+    Future(Job job, std::shared_ptr<T> result)
+            : m_job(job)
+            , m_result(result) {}
 
-    void draw();
+    bool       ready() const { return m_job.done(); }
+    const T&   get() const { return m_job.wait(), *m_result; }
+    const Job& job() const { return m_job; }
 };
 
-HOST_API std::vector<Object>& getObjects();
-HOST_API Object& addObject(float x, float y);
+// submitJob() for work returning a default constructible type - auto sum = submitTask([]() { return 1 + 2; }); sum.get();
+template <typename F>
+auto submitTask(F work, const std::vector<Job>& dependencies = {}) -> Future<decltype(work())> {
+    auto result = std::make_shared<decltype(work())>();
+    auto job    = submitJob([work, result]() mutable { *result = work(); }, dependencies);
+    return Future<decltype(work())>(job, result);
+}
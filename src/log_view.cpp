@@ -0,0 +1,149 @@
+#include "log_view.h"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+
+LogView::LogView(bool mark_errors, size_t max_size)
+        : m_line_starts(1, 0)
+        , m_max_size(max_size)
+        , m_mark_errors(mark_errors) {}
+
+void LogView::append(const string& text, bool highlight) {
+    // even empty text replaces the highlighted lines
+    if(text.empty() && !highlight)
+        return;
+    m_pending.push_back({text, 0, highlight});
+    m_pending_size += text.size();
+}
+
+void LogView::clear() {
+    m_text.clear();
+    m_line_starts.assign(1, 0);
+    m_error_lines.clear();
+    m_pending.clear();
+    m_pending_size    = 0;
+    m_dropped_lines   = 0;
+    m_highlight_begin = 0;
+    m_highlight_end   = 0;
+    m_scroll_to       = size_t(-1);
+}
+
+// appends the text and indexes the lines completed by it
+void LogView::add(const char* text, size_t size) {
+    auto first_new = m_line_starts.size() - 1; // the open line might be continued
+    m_text.append(text, size);
+    for(auto pos = m_text.find('\n', m_line_starts.back()); pos != string::npos; pos = m_text.find('\n', pos + 1))
+        m_line_starts.push_back(pos + 1);
+
+    if(m_mark_errors) {
+        static const char error[] = "error";
+        for(auto line = first_new; line + 1 < m_line_starts.size(); ++line) {
+            auto begin = m_text.begin() + m_line_starts[line];
+            auto end   = m_text.begin() + m_line_starts[line + 1];
+            if(search(begin, end, error, error + sizeof(error) - 1) != end) {
+                // the first error gets scrolled to instead of the end of the log
+                if(m_error_lines.empty() && m_dropped_lines == 0)
+                    m_scroll_to = line;
+                m_error_lines.push_back(m_dropped_lines + line);
+            }
+        }
+    }
+
+    if(m_text.size() > m_max_size)
+        drop_oldest_lines();
+}
+
+// drops a quarter of the text at once so the cost of moving the rest is amortized - the oldest bytes of the open line
+// are dropped as well if it's longer than that on its own (output without a newline)
+void LogView::drop_oldest_lines() {
+    auto target = m_text.size() - m_max_size * 3 / 4;
+    auto line   = size_t(upper_bound(m_line_starts.begin(), m_line_starts.end() - 1, target) - m_line_starts.begin());
+    auto offset = max(m_line_starts[line], target);
+
+    m_text.erase(0, offset);
+    m_line_starts.erase(m_line_starts.begin(), m_line_starts.begin() + line);
+    for(auto& start : m_line_starts)
+        start -= min(start, offset); // the open line starts at 0 if its beginning has been dropped
+    m_dropped_lines += line;
+    m_error_lines.erase(m_error_lines.begin(),
+                        lower_bound(m_error_lines.begin(), m_error_lines.end(), m_dropped_lines));
+    if(m_scroll_to != size_t(-1))
+        m_scroll_to = m_scroll_to > line ? m_scroll_to - line : 0;
+}
+
+bool LogView::ingest(double budget_ms) {
+    if(m_pending.empty())
+        return false;
+
+    // in pieces of at most 64 KB - their size is irrelevant for the cost of ingesting them so checking the time after
+    // each piece keeps the frame within the budget
+    auto deadline = chrono::steady_clock::now() + chrono::duration<double, milli>(budget_ms);
+    do {
+        auto& pending = m_pending.front();
+        if(pending.offset == 0 && pending.highlight) {
+            m_highlight_begin = m_dropped_lines + m_line_starts.size() - 1;
+            m_highlight_end   = m_highlight_begin;
+        }
+        auto size = min<size_t>(pending.text.size() - pending.offset, 64 * 1024);
+        add(pending.text.data() + pending.offset, size);
+        pending.offset += size;
+        m_pending_size -= size;
+        if(pending.highlight)
+            m_highlight_end = m_dropped_lines + line_count();
+        if(pending.offset == pending.text.size())
+            m_pending.pop_front();
+    } while(m_pending.size() && chrono::steady_clock::now() < deadline);
+    return true;
+}
+
+void LogView::render(const char* id) {
+    ImGui::BeginChild(id, ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
+
+    auto line_height = ImGui::GetTextLineHeightWithSpacing();
+    auto window_x    = ImGui::GetWindowPos().x;
+    auto error       = m_error_lines.begin();
+
+    ImGuiListClipper clipper;
+    clipper.Begin(int(line_count()), line_height);
+    while(clipper.Step()) {
+        error = lower_bound(error, m_error_lines.end(), m_dropped_lines + clipper.DisplayStart);
+        for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+            auto line = m_dropped_lines + i;
+            if(line >= m_highlight_begin && line < m_highlight_end) {
+                auto pos = ImGui::GetCursorScreenPos();
+                ImGui::GetWindowDrawList()->AddRectFilled(ImVec2(window_x, pos.y),
+                                                          ImVec2(window_x + ImGui::GetWindowWidth(), pos.y + line_height),
+                                                          IM_COL32(255, 255, 255, 24));
+            }
+            bool is_error = error != m_error_lines.end() && *error == line;
+            if(is_error) {
+                ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1, 0.3f, 0.3f, 1));
+                ++error;
+            }
+            // without the new line character
+            auto end = size_t(i + 1) < m_line_starts.size() ? m_line_starts[i + 1] - 1 : m_text.size();
+            ImGui::TextUnformatted(m_text.data() + m_line_starts[i], m_text.data() + end);
+            if(is_error)
+                ImGui::PopStyleColor();
+        }
+    }
+
+    // stays at the end while new lines are added if it was there at the start of the frame - unless jumping to a line
+    if(m_scroll_to != size_t(-1)) {
+        ImGui::SetScrollY(m_scroll_to * line_height);
+        m_scroll_to = size_t(-1);
+    } else if(ImGui::GetScrollY() >= ImGui::GetScrollMaxY()) {
+        ImGui::SetScrollY(line_count() * line_height);
+    }
+
+    if(ImGui::BeginPopupContextWindow()) {
+        if(ImGui::MenuItem("Copy all"))
+            ImGui::SetClipboardText(m_text.c_str());
+        ImGui::EndPopup();
+    }
+    ImGui::EndChild();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+
+// A read-only view of a log which might get huge (megabytes of template errors from the compiler):
+// - appended text is queued and ingested a bit at a time by ingest() - within a time budget per frame
+// - only the visible lines are laid out when rendering - through ImGuiListClipper
+// - the oldest lines are dropped once the text exceeds max_size bytes so the memory is bounded - the oldest bytes of a
+//   single line which is longer than that (output without newlines) as well
+class LogView
+{
+    // text waiting to be ingested
+    struct Pending
+    {
+        std::string text;
+        size_t      offset;    // what has already been ingested
+        bool        highlight; // the lines from it replace the highlighted ones
+    };
+
+    std::string         m_text;
+    std::vector<size_t> m_line_starts; // offsets in m_text - the last line is open (and empty) if the text ends with '\n'
+    std::vector<size_t> m_error_lines; // absolute line numbers (counting the dropped ones) in increasing order
+    std::deque<Pending> m_pending;
+    size_t              m_pending_size    = 0;
+    size_t              m_max_size        = 0;
+    bool                m_mark_errors     = false;
+    size_t              m_dropped_lines   = 0;
+    size_t              m_highlight_begin = 0; // absolute line numbers of the highlighted range
+    size_t              m_highlight_end   = 0;
+    size_t              m_scroll_to       = size_t(-1); // the first error - jumped to in the next frame
+
+    void add(const char* text, size_t size);
+    void drop_oldest_lines();
+
+public:
+    // lines containing "error" are shown in red if mark_errors is set
+    explicit LogView(bool mark_errors = false, size_t max_size = 64 << 20);
+
+    // queues text for ingestion - the lines from the last text appended with highlight set are highlighted
+    void append(const std::string& text, bool highlight = false);
+    void clear();
+
+    // ingests queued text for about budget_ms milliseconds (at least a 64 KB piece of it) - returns true if anything
+    // was ingested (the next frame should be drawn)
+    bool ingest(double budget_ms);
+    bool has_pending() const { return m_pending_size > 0; }
+
+    size_t line_count() const { return m_line_starts.size() - (m_text.size() == m_line_starts.back()); }
+    size_t dropped_lines() const { return m_dropped_lines; }
+    // renders the lines in a child window filling the available space
+    void render(const char* id);
+};
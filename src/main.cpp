@@ -1,13 +1,26 @@
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <list>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <ctime>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif // _WIN32
 
 #include <GLFW/glfw3.h>
 #include <third_party/ImGuiColorTextEdit/TextEditor.h>
 #include <third_party/imgui/examples/opengl2_example/imgui_impl_glfw_gl2.h>
 
 #include "host_app.h"
+#include "log_view.h"
 #include "rcrl/rcrl.h"
+#include "rcrl/rcrl_parser.h"
+#include "rcrl/rcrl_watch.h"
 
 using namespace std;
 
@@ -15,6 +28,14 @@ using namespace std;
 
 bool g_console_visible = !RCRL_LIVE_DEMO;
 
+// the code in the console is compiled in the background once it hasn't changed for this long (if speculation is on)
+int g_speculation_debounce_ms = 500;
+
+// output is ingested by the log views for at most this long per frame - the rest is left for the next frames
+double g_output_budget_ms = 4;
+// compiler output taken from RCRL per frame - its diagnostics are translated when taken
+size_t g_compiler_output_budget = 256 * 1024;
+
 // my own callback - need to add the new line symbols to make ImGuiColorTextEdit work when 'enter' is pressed
 void My_ImGui_ImplGlfwGL2_KeyCallback(GLFWwindow* w, int key, int scancode, int action, int mods) {
     // calling the callback from the imgui/glfw integration only if not a dash because when writing an underscore (with shift down)
@@ -33,7 +54,300 @@ void My_ImGui_ImplGlfwGL2_KeyCallback(GLFWwindow* w, int key, int scancode, int
         g_console_visible = !g_console_visible;
 }
 
-int main() {
+// the CPU time used by the process so far (all of its threads) - in seconds
+double get_cpu_time() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+    auto to_seconds = [](FILETIME time) { return (uint64_t(time.dwHighDateTime) << 32 | time.dwLowDateTime) * 1e-7; };
+    return to_seconds(kernel) + to_seconds(user);
+#else  // _WIN32
+    return double(clock()) / CLOCKS_PER_SEC;
+#endif // _WIN32
+}
+
+// the CPU usage of the process and how much of the time the main loop sleeps - measured over a second at a time
+struct CpuUsage
+{
+    chrono::steady_clock::time_point start         = chrono::steady_clock::now();
+    double                           cpu_start     = get_cpu_time();
+    double                           slept         = 0; // seconds spent waiting for events - added by the main loop
+    int                              frames        = 0;
+    int                              busy          = 0; // frames drawn at the full rate
+    double                           idle_time     = 0; // the seconds without such frames - and the CPU time used in them
+    double                           idle_cpu_time = 0;
+
+    // the results for the last second - in percent - and the average CPU usage over the idle seconds
+    double fps = 0, cpu = 0, asleep = 0, idle_cpu = 0;
+
+    void add_frame(bool at_full_rate) {
+        frames++;
+        busy += at_full_rate;
+        auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if(elapsed < 1)
+            return;
+
+        auto cpu_time = get_cpu_time() - cpu_start;
+        fps           = frames / elapsed;
+        cpu           = 100 * cpu_time / elapsed;
+        asleep        = 100 * slept / elapsed;
+        if(busy == 0) {
+            idle_time += elapsed;
+            idle_cpu_time += cpu_time;
+            idle_cpu = 100 * idle_cpu_time / idle_time;
+        }
+        start     = chrono::steady_clock::now();
+        cpu_start = get_cpu_time();
+        slept     = 0;
+        frames    = 0;
+        busy      = 0;
+    }
+};
+
+// draws the callees of a node of the call graph from a profile - the calls with most of the samples are expanded
+void draw_call_graph(const rcrl::ProfileNode& node, size_t total) {
+    for(const auto& child : node.children) {
+        int flags = (child.children.empty() ? ImGuiTreeNodeFlags_Leaf : 0) |
+                    (child.samples * 2 > total ? ImGuiTreeNodeFlags_DefaultOpen : 0);
+        if(ImGui::TreeNodeEx(&child, flags, "%5.1f%% %s", 100.0 * child.samples / total, child.name.c_str())) {
+            draw_call_graph(child, total);
+            ImGui::TreePop();
+        }
+    }
+}
+
+// draws a list from a compile time report - under a collapsing header
+void draw_compile_time_entries(const char* label, const vector<rcrl::CompileTimeEntry>& entries, int flags = 0) {
+    if(entries.empty() || !ImGui::CollapsingHeader(label, flags))
+        return;
+    for(const auto& entry : entries) {
+        // GCC doesn't time headers - those are weighed only by how many headers they include
+        if(entry.time > 0)
+            ImGui::Text("%9.1f ms %6d  %s", entry.time * 1000, int(entry.count), entry.name.c_str());
+        else
+            ImGui::Text("%12s %6d  %s", "", int(entry.count), entry.name.c_str());
+    }
+}
+
+// lists the plugins and the persistent variables by what they cost - the most expensive first
+void draw_memory_dashboard() {
+    auto plugins = rcrl::get_plugin_infos();
+    auto vars    = rcrl::get_var_infos();
+
+    size_t file_size = 0, mapped_size = 0, heap_growth = 0, vars_heap_size = 0;
+    for(const auto& plugin : plugins) {
+        file_size += plugin.unloaded ? 0 : plugin.file_size;
+        mapped_size += plugin.unloaded ? 0 : plugin.mapped_size;
+        heap_growth += plugin.heap_growth;
+    }
+    for(const auto& var : vars)
+        vars_heap_size += var.heap_size;
+    ImGui::Text("%d plugins: %d KB on disk, %d KB mapped, %d KB of heap growth - %d vars with %d KB of heap",
+                int(plugins.size()), int(file_size / 1024), int(mapped_size / 1024), int(heap_growth / 1024),
+                int(vars.size()), int(vars_heap_size / 1024));
+
+    // the unloaded plugins cost only the heap they have left behind
+    auto plugin_cost = [](const rcrl::PluginInfo& info) {
+        return (info.unloaded ? 0 : info.mapped_size) + info.heap_growth;
+    };
+    vector<size_t> order(plugins.size());
+    for(size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    sort(order.begin(), order.end(),
+         [&](size_t lhs, size_t rhs) { return plugin_cost(plugins[lhs]) > plugin_cost(plugins[rhs]); });
+    if(ImGui::CollapsingHeader("plugins", ImGuiTreeNodeFlags_DefaultOpen)) {
+        ImGui::Text("  plugin  mapped KB  heap KB  file KB  load ms  vars  vars KB");
+        ImGui::Separator();
+        for(auto i : order) {
+            const auto& plugin = plugins[i];
+            ImGui::Text("%8d %10d %8d %8d %8.2f %5d %8d%s", int(i), int(plugin.mapped_size / 1024),
+                        int(plugin.heap_growth / 1024), int(plugin.file_size / 1024), plugin.load_time * 1000,
+                        int(plugin.num_vars), int((plugin.vars_size + plugin.vars_heap_size) / 1024),
+                        plugin.unloaded ? "  (unloaded)" : "");
+        }
+    }
+
+    // the heap size includes the object itself - only the size is known without heap statistics
+    sort(vars.begin(), vars.end(), [](const rcrl::VarInfo& lhs, const rcrl::VarInfo& rhs) {
+        return max(lhs.size, lhs.heap_size) > max(rhs.size, rhs.heap_size);
+    });
+    if(ImGui::CollapsingHeader("vars", ImGuiTreeNodeFlags_DefaultOpen)) {
+        ImGui::Text("   bytes  heap bytes  plugin  name");
+        ImGui::Separator();
+        for(const auto& var : vars)
+            ImGui::Text("%8d %11d %7d  %s", int(var.size), int(var.heap_size), var.plugin, var.name.c_str());
+    }
+}
+
+// splits code into submissions - each ends with the once sections after which a global or vars section follows so the
+// once sections run before the code after them is compiled - returns the submissions with their starting lines
+vector<pair<string, size_t>> split_into_submissions(const string& code) {
+    string stripped = code;
+    auto   sections = rcrl::parse_sections_and_remove_comments(stripped, rcrl::ONCE);
+
+    // the offsets at which lines start - sections are reported with the line of their directive
+    vector<size_t> line_starts = {0};
+    for(size_t i = 0; i < code.size(); ++i)
+        if(code[i] == '\n')
+            line_starts.push_back(i + 1);
+
+    vector<pair<string, size_t>> out;
+    size_t                       start = 0;
+    size_t                       line  = 1;
+    for(size_t i = 1; i < sections.size(); ++i) {
+        auto executed = [&](size_t k) { return sections[k].mode == rcrl::ONCE || sections[k].mode == rcrl::BENCH; };
+        if(executed(i) || !executed(i - 1))
+            continue;
+        // split only if there is code before the directive of the section
+        auto end = line_starts[sections[i].line - 1];
+        if(stripped.find_first_not_of(" \t\r\n", start) < end) {
+            out.push_back({code.substr(start, end - start), line});
+            start = end;
+            line  = sections[i].line;
+        }
+    }
+    if(stripped.find_first_not_of(" \t\r\n", start) != string::npos)
+        out.push_back({code.substr(start), line});
+    return out;
+}
+
+// a submission or a checkpoint/rollback marker in a file run by run_batch()
+struct BatchStep
+{
+    enum Kind
+    {
+        SUBMISSION,
+        CHECKPOINT,
+        ROLLBACK
+    };
+
+    Kind   kind;
+    string code;
+    size_t line;
+};
+
+// splits code into submissions (see split_into_submissions()) and the '// checkpoint' and '// rollback' lines between
+// them - the code after such a line starts in the default (once) section unless it starts with a section directive
+vector<BatchStep> split_into_steps(const string& code) {
+    vector<BatchStep> out;
+    size_t            start      = 0;
+    size_t            start_line = 1;
+    auto              add_code   = [&](size_t end) {
+        for(const auto& submission : split_into_submissions(code.substr(start, end - start)))
+            out.push_back({BatchStep::SUBMISSION, submission.first, start_line + submission.second - 1});
+    };
+
+    size_t line = 1;
+    for(size_t pos = 0; pos < code.size(); ++line) {
+        auto end     = min(code.find('\n', pos), code.size());
+        auto first   = code.find_first_not_of(" \t", pos);
+        auto last    = code.find_last_not_of(" \t\r", end - 1);
+        auto trimmed = first < end && last != string::npos && last >= first ? code.substr(first, last - first + 1) : "";
+        if(trimmed == "// checkpoint" || trimmed == "// rollback") {
+            add_code(pos);
+            out.push_back({trimmed == "// checkpoint" ? BatchStep::CHECKPOINT : BatchStep::ROLLBACK, "", line});
+            start      = min(end + 1, code.size());
+            start_line = line + 1;
+        }
+        pos = end + 1;
+    }
+    add_code(code.size());
+    return out;
+}
+
+// runs a file with code without a window - the compiler output goes to stderr and the program output to stdout:
+// - the build of the next submission overlaps with loading the current one and running its once sections
+// - a '// checkpoint' line forks the process (see rcrl::checkpoint()) and a '// rollback' line continues after itself
+//   with the state of the last checkpoint - for trying out code on top of state which takes long to set up
+// - returns the exit code of the first failing compilation (1 if a submission can't be parsed or a plugin is rejected
+//   when loading it)
+int run_batch(const char* path) {
+    ifstream in(path, ios::binary);
+    if(!in) {
+        fprintf(stderr, "cannot open '%s'\n", path);
+        return 1;
+    }
+    auto steps = split_into_steps(string(istreambuf_iterator<char>(in), istreambuf_iterator<char>()));
+
+    int exitcode = 0;
+    for(size_t i = 0; i < steps.size() && exitcode == 0; ++i) {
+        if(steps[i].kind == BatchStep::CHECKPOINT) {
+            // the job threads don't survive fork() - a rollback returns the index of the step after it
+            stopJobThreads();
+            int resumed = rcrl::checkpoint();
+            startJobThreads();
+            if(resumed < 0) {
+                fprintf(stderr, "%s:%d: checkpoints aren't supported\n", path, int(steps[i].line));
+                exitcode = 1;
+            } else if(resumed > 0) {
+                fprintf(stderr, "%s:%d: rolled back to the checkpoint on line %d\n", path, int(steps[resumed - 1].line),
+                        int(steps[i].line));
+                i = size_t(resumed) - 1;
+            }
+            continue;
+        }
+        if(steps[i].kind == BatchStep::ROLLBACK) {
+            if(rcrl::get_checkpoint_count() == 0) {
+                fprintf(stderr, "%s:%d: rollback without a checkpoint\n", path, int(steps[i].line));
+                exitcode = 1;
+                continue;
+            }
+            rcrl::rollback(int(i + 1));
+        }
+
+        auto is_submission = [](const BatchStep& step) { return step.kind == BatchStep::SUBMISSION; };
+        auto submission    = int(count_if(steps.begin(), steps.begin() + i + 1, is_submission));
+        auto submissions   = int(count_if(steps.begin(), steps.end(), is_submission));
+        fprintf(stderr, "%s:%d: compiling submission %d of %d\n", path, int(steps[i].line), submission, submissions);
+        // nothing is compiled when the code can't be parsed (a bad vars section) - the errors are the compiler output
+        if(!rcrl::submit_code(steps[i].code)) {
+            auto errors = rcrl::get_new_compiler_output();
+            if(errors.size() && errors.back() != '\n')
+                errors += '\n';
+            fputs(errors.c_str(), stderr);
+            fprintf(stderr, "%s:%d: submission %d of %d couldn't be parsed\n", path, int(steps[i].line), submission,
+                    submissions);
+            exitcode = 1;
+            continue;
+        }
+
+        while(!rcrl::try_get_exit_status_from_compile(exitcode)) {
+            fputs(rcrl::get_new_compiler_output().c_str(), stderr);
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        fputs(rcrl::get_new_compiler_output().c_str(), stderr);
+
+        if(exitcode == 0) {
+            if(i + 1 < steps.size() && steps[i + 1].kind == BatchStep::SUBMISSION && !rcrl::is_jit_backend())
+                rcrl::speculate_code_after_load(steps[i + 1].code);
+            rcrl::copy_and_load_new_plugin();
+            fflush(stdout);
+            if(rcrl::get_last_load_error().size()) {
+                fprintf(stderr, "%s:%d: the submission has been rejected when loading it\n", path, int(steps[i].line));
+                exitcode = 1;
+            }
+        }
+    }
+
+    rcrl::cleanup_plugins();
+    // exit codes are truncated to a byte by the shell - a failure should never look like a success
+    return exitcode == 0 || (exitcode & 0xff) ? exitcode : 1;
+}
+
+int main(int argc, char** argv) {
+    // jobs submitted by the code of a plugin are done before the submission is considered done - and before unloading
+    rcrl::set_plugin_barrier(waitForJobs);
+
+    // headless mode for scripted runs: host_app --batch file.rcrl
+    if(argc == 3 && strcmp(argv[1], "--batch") == 0)
+        return run_batch(argv[2]);
+
+    // live reload of files edited outside of the console: host_app --watch file.rcrl [more files]
+    if(argc > 2 && strcmp(argv[1], "--watch") == 0)
+        for(int i = 2; i < argc; ++i)
+            if(!rcrl::watch_file(argv[i]))
+                fprintf(stderr, "cannot watch '%s'\n", argv[i]);
+
     // Setup window
     glfwSetErrorCallback([](int error, const char* description) { fprintf(stderr, "%d %s", error, description); });
     if(!glfwInit())
@@ -62,17 +376,14 @@ int main() {
     history.SetReadOnly(true);
     // this is the precompiled header for the plugin in this demo project so it's contents are always there for the plugin
     history.SetText("#include \"precompiled_for_plugin.h\"\n");
+    // the length of the history before the code of each loaded plugin - for undoing them
+    vector<size_t> history_lengths;
 
-    // an editor instance - compiler output - with an empty language definition and a custom palette
-    TextEditor compiler_output;
-    compiler_output.SetLanguageDefinition(TextEditor::LanguageDefinition());
-    compiler_output.SetReadOnly(true);
-    auto custom_palette                                             = TextEditor::GetDarkPalette();
-    custom_palette[(int)TextEditor::PaletteIndex::MultiLineComment] = 0xcccccccc; // text is treated as such by default
-    compiler_output.SetPalette(custom_palette);
+    // compiler output - the lines with errors are marked
+    LogView compiler_output(true);
 
-    // holds the standard output from while loading the plugin - same as the compiler output as a theme
-    TextEditor program_output(compiler_output);
+    // holds the standard output from while loading the plugin - the output from the last load is highlighted
+    LogView program_output;
 
     // an editor instance - for the core being currently written
     TextEditor editor;
@@ -101,24 +412,71 @@ cout << vec.size() << endl;
     bool       used_default_mode = false;
     rcrl::Mode default_mode      = rcrl::ONCE;
 
+    // state for speculative compilation of the code in the console while the user is typing (not with the JIT backend)
+    bool       speculate           = !rcrl::is_jit_backend();
+    bool       speculation_started = false;
+    string     last_console_code;
+    rcrl::Mode last_console_mode = default_mode;
+    auto       last_console_edit = chrono::steady_clock::now();
+
+    // the profile of the code executed when loading the last plugin - if profiling
+    bool          profiling = false;
+    rcrl::Profile last_profile;
+
+    // the cost of the plugins and the persistent variables in a separate window
+    bool show_memory = false;
+
+    // what the last compilation spent its time on - empty unless the plugin is built with RCRL_PLUGIN_TIME_REPORT
+    rcrl::CompileTimeReport time_report;
+
+    // the code from the watched files which is being compiled - if any
+    bool   compiling_watched = false;
+    string watched_code;
+
     // limiting to 50 fps because on some systems the whole machine started lagging when the demo was turned on
     using frames   = chrono::duration<int64_t, ratio<1, 60>>;
     auto nextFrame = chrono::system_clock::now() + frames{0};
 
+    // frames are drawn at the full rate only while something changes - otherwise the loop sleeps until there is input,
+    // output from a build (the notifier posts an empty event) or a deadline such as the debounce of speculation
+    int      busy_frames = 0; // left to draw at the full rate
+    bool     watching    = argc > 2 && strcmp(argv[1], "--watch") == 0;
+    CpuUsage usage;
+    rcrl::set_output_notifier(glfwPostEmptyEvent);
+
+    // build the precompiled header for the plugin in the background so the first submission isn't slower than the rest
+    rcrl::start_warmup();
+
     // add objects in scene
-    for(int i = 0; i < 4; ++i) {
-        for(int k = 0; k < 4; ++k) {
-            auto& obj = addObject(-7.5f + k * 5, -4.5f + i * 3);
-            obj.colorize(float(i % 2), float(k % 2), 0);
-        }
-    }
+    addDemoScene();
 
     // main loop
     while(!glfwWindowShouldClose(window)) {
-        // poll for events
-        glfwPollEvents();
+        // poll for events - or wait for them when idle
+        if(busy_frames > 0) {
+            glfwPollEvents();
+        } else {
+            double timeout = watching ? 0.1 : 0.5; // the watched files are polled
+            if(speculate && !speculation_started && last_console_code.size() > 1) {
+                auto debounce_end = last_console_edit + chrono::milliseconds(g_speculation_debounce_ms);
+                timeout = min(timeout, chrono::duration<double>(debounce_end - chrono::steady_clock::now()).count());
+            }
+            auto sleep_start = chrono::steady_clock::now();
+            glfwWaitEventsTimeout(max(timeout, 0.001));
+            auto slept = chrono::duration<double>(chrono::steady_clock::now() - sleep_start).count();
+            usage.slept += slept;
+            // ImGui reacts to some of the input a frame later - the frame after a wake-up from an event is drawn as well
+            if(slept < timeout)
+                busy_frames = 2;
+            nextFrame = chrono::system_clock::now();
+        }
         ImGui_ImplGlfwGL2_NewFrame();
 
+        // the scene or the output changes in this frame - so the next one is drawn at the full rate as well (rotation
+        // nobody can see doesn't keep the loop awake)
+        bool active = objectsMoving() && glfwGetWindowAttrib(window, GLFW_VISIBLE) &&
+                      !glfwGetWindowAttrib(window, GLFW_ICONIFIED);
+
         // handle window stretching
         int display_w, display_h;
         glfwGetFramebufferSize(window, &display_w, &display_h);
@@ -129,15 +487,12 @@ cout << vec.size() << endl;
         ImGui::SetNextWindowSize({(float)window_w, -1.f}, ImGuiCond_Always);
         ImGui::SetNextWindowPos({0.f, 0.f}, ImGuiCond_Always);
 
-        // sets breakpoints on the program_output instance of the text editor widget - used to highlight new output
-        auto do_breakpoints_on_output = [&](int old_line_count, const std::string& new_output) {
-            TextEditor::Breakpoints bps;
-            if(old_line_count == program_output.GetTotalLines() && new_output.size())
-                bps.insert(old_line_count);
-            for(auto curr_line = old_line_count; curr_line < program_output.GetTotalLines(); ++curr_line)
-                bps.insert(curr_line);
-            program_output.SetBreakpoints(bps);
-        };
+        // a bit of the output at a time - a huge log doesn't stall the frame in which it arrives
+        if(g_console_visible) {
+            compiler_output.append(rcrl::get_new_compiler_output(g_compiler_output_budget));
+            active |= compiler_output.ingest(g_output_budget_ms);
+            active |= program_output.ingest(g_output_budget_ms);
+        }
 
         if(g_console_visible &&
            ImGui::Begin("console", nullptr,
@@ -153,45 +508,15 @@ cout << vec.size() << endl;
             ImGui::SameLine();
             // top right part
             ImGui::BeginChild("compiler output", ImVec2(0, text_field_height));
-            auto new_output = rcrl::get_new_compiler_output();
-            if(new_output.size()) {
-                auto total_output = compiler_output.GetText() + new_output;
-
-                // scan for errors through the lines and highlight them with markers
-                auto                     curr_pos                = 0;
-                auto                     line                    = 1;
-                auto                     first_error_marker_line = 0;
-                TextEditor::ErrorMarkers error_markers;
-                do {
-                    auto new_curr_pos_1 = total_output.find("error", curr_pos + 1); // add 1 to skip new lines
-                    auto new_curr_pos_2 = total_output.find("\n", curr_pos + 1);    // add 1 to skip new lines
-                    if(new_curr_pos_1 < new_curr_pos_2) {
-                        error_markers.insert(make_pair(line, ""));
-                        if(!first_error_marker_line)
-                            first_error_marker_line = line;
-                    }
-                    if(new_curr_pos_2 < new_curr_pos_1) {
-                        line++;
-                    }
-                    curr_pos = min(new_curr_pos_1, new_curr_pos_2);
-                } while(size_t(curr_pos) != string::npos);
-                compiler_output.SetErrorMarkers(error_markers);
-
-                // update compiler output
-                compiler_output.SetText(move(total_output));
-                if(first_error_marker_line)
-                    compiler_output.SetCursorPosition({first_error_marker_line, 1});
-                else
-                    compiler_output.SetCursorPosition({compiler_output.GetTotalLines(), 1});
-            }
             if(last_compiler_exitcode)
                 ImGui::TextColored({1, 0, 0, 1}, "Compiler output - ERROR!");
-            else
+            else if(rcrl::is_compiling())
                 ImGui::Text("Compiler output:        ");
+            else
+                ImGui::Text("Compiler output: %5.2fs ", rcrl::get_last_compile_time());
             ImGui::SameLine();
-            auto cocpos = compiler_output.GetCursorPosition();
-            ImGui::Text("%3d/%-3d %3d lines", cocpos.mLine + 1, cocpos.mColumn + 1, compiler_output.GetTotalLines());
-            compiler_output.Render("Compiler output");
+            ImGui::Text("%d lines", int(compiler_output.line_count()));
+            compiler_output.render("Compiler output");
             ImGui::EndChild();
 
             // bottom left part
@@ -204,10 +529,9 @@ cout << vec.size() << endl;
             ImGui::SameLine();
             // bottom right part
             ImGui::BeginChild("program output", ImVec2(0, text_field_height));
-            auto ocpos = program_output.GetCursorPosition();
-            ImGui::Text("Program output: %3d/%-3d %3d lines", ocpos.mLine + 1, ocpos.mColumn + 1,
-                        program_output.GetTotalLines());
-            program_output.Render("Output");
+            ImGui::Text("Program output: %d lines (%d dropped)", int(program_output.line_count()),
+                        int(program_output.dropped_lines()));
+            program_output.render("Output");
             ImGui::EndChild();
 
             // bottom buttons
@@ -219,30 +543,66 @@ cout << vec.size() << endl;
             ImGui::SameLine();
             ImGui::RadioButton("once", (int*)&default_mode, rcrl::ONCE);
             ImGui::SameLine();
+            ImGui::RadioButton("bench", (int*)&default_mode, rcrl::BENCH);
+            ImGui::SameLine();
             auto compile = ImGui::Button("Compile and run");
             ImGui::SameLine();
             if(ImGui::Button("Cleanup Plugins") && !rcrl::is_compiling()) {
-                compiler_output.SetText("");
-                auto output_from_cleanup = rcrl::cleanup_plugins(true);
-                auto old_line_count      = program_output.GetTotalLines();
-                program_output.SetText(program_output.GetText() + output_from_cleanup);
-                program_output.SetCursorPosition({program_output.GetTotalLines(), 0});
+                compiler_output.clear();
+                // highlight the new stdout lines
+                program_output.append(rcrl::cleanup_plugins(true), true);
 
                 last_compiler_exitcode = 0;
                 history.SetText("#include \"precompiled_for_plugin.h\"\n");
-
-                // highlight the new stdout lines
-                do_breakpoints_on_output(old_line_count, output_from_cleanup);
+                history_lengths.clear();
+                // the code from the watched files is gone as well - apply them again in full
+                rcrl::reset_file_watches();
+            }
+            // the watched files aren't applied again after that - so only without them
+            if(!watching && history_lengths.size() && !rcrl::is_jit_backend()) {
+                ImGui::SameLine();
+                if(ImGui::Button("Undo") && !rcrl::is_compiling()) {
+                    program_output.append(rcrl::undo(1, true), true);
+                    history.SetText(history.GetText().substr(0, history_lengths.back()));
+                    history_lengths.pop_back();
+                }
             }
             ImGui::SameLine();
             if(ImGui::Button("Clear Output"))
-                program_output.SetText("");
+                program_output.clear();
+            if(!rcrl::is_jit_backend()) {
+                ImGui::SameLine();
+                if(ImGui::Checkbox("Speculative", &speculate) && !speculate)
+                    rcrl::cancel_speculation();
+            }
+            ImGui::SameLine();
+            if(ImGui::Checkbox("Profile", &profiling))
+                rcrl::set_profiling(profiling);
+            ImGui::SameLine();
+            ImGui::Checkbox("Memory", &show_memory);
+            ImGui::SameLine();
+            ImGui::Text("| %3.0f fps, %4.1f%% CPU, asleep %3.0f%% (%.1f%% CPU when idle)", usage.fps, usage.cpu,
+                        usage.asleep, usage.idle_cpu);
             ImGui::SameLine();
             ImGui::Dummy({20, 0});
             ImGui::SameLine();
 #if !RCRL_LIVE_DEMO
             ImGui::Text("Use Ctrl+Enter to submit code");
+            ImGui::SameLine();
 #endif // RCRL_LIVE_DEMO
+            auto plugin_infos = rcrl::get_plugin_infos();
+            if(plugin_infos.size()) {
+                int    num_unloaded = 0;
+                size_t reclaimed    = 0;
+                for(const auto& info : plugin_infos) {
+                    num_unloaded += info.unloaded;
+                    reclaimed += info.reclaimed;
+                }
+                ImGui::Text("| %d plugins (%d unloaded, %d KB reclaimed), last: %d KB file, %d KB mapped, loaded in %.2f ms",
+                            int(plugin_infos.size()), num_unloaded, int(reclaimed / 1024),
+                            int(plugin_infos.back().file_size / 1024), int(plugin_infos.back().mapped_size / 1024),
+                            plugin_infos.back().load_time * 1000);
+            }
 
             // if the user has submitted code for compilation
 #if RCRL_LIVE_DEMO
@@ -258,7 +618,7 @@ cout << vec.size() << endl;
 #endif // RCRL_LIVE_DEMO
             if(compile && !rcrl::is_compiling() && editor.GetText().size() > 1) {
                 // clear compiler output
-                compiler_output.SetText("");
+                compiler_output.clear();
 
                 auto getCodePrefix = [&]() {
 #ifdef __APPLE__ // related to this: https://github.com/onqtam/rcrl/issues/4
@@ -266,8 +626,7 @@ cout << vec.size() << endl;
                     if(first_time_called) {
                         first_time_called = false;
                         return string("//global\n#include \"precompiled_for_plugin.h\"\n") +
-                               (default_mode == rcrl::GLOBAL ? "// global\n" :
-                                                               (default_mode == rcrl::VARS ? "// vars\n" : "// once\n"));
+                               rcrl::section_directive(default_mode);
                     }
 #endif
                     return string("");
@@ -287,41 +646,148 @@ cout << vec.size() << endl;
             ImGui::End();
         }
 
+        // compile the code in the console in the background once it has been stable for a while - if it is then
+        // submitted unchanged the result is used right away, and if it changes the speculative build is discarded
+        if(speculate && !rcrl::is_compiling() && !rcrl::is_warming_up()) {
+            auto console_code = editor.GetText();
+            auto now          = chrono::steady_clock::now();
+            if(console_code != last_console_code || default_mode != last_console_mode) {
+                if(speculation_started)
+                    rcrl::cancel_speculation();
+                speculation_started = false;
+                last_console_code   = move(console_code);
+                last_console_mode   = default_mode;
+                last_console_edit   = now;
+            } else if(!speculation_started && last_console_code.size() > 1 &&
+                      now - last_console_edit > chrono::milliseconds(g_speculation_debounce_ms)) {
+                // returns false if the code doesn't parse - nothing to do until it changes then
+                rcrl::speculate_code(last_console_code, default_mode);
+                speculation_started = true;
+            }
+        }
+
+        // submit the changes in the watched files - a build for an older version of them is superseded
+        string changed_code;
+        if((!rcrl::is_compiling() || compiling_watched) && rcrl::poll_file_watches(changed_code)) {
+            if(rcrl::is_compiling())
+                rcrl::cancel_compile();
+            compiler_output.clear();
+            // an applied global or vars section has changed - the plugins since its file has first been applied go away
+            // (along with their code in the history) and the file is compiled again in full
+            if(auto undo_count = rcrl::get_file_watches_undo_count()) {
+                if(rcrl::is_jit_backend())
+                    program_output.append(rcrl::cleanup_plugins(true), true);
+                else
+                    program_output.append(rcrl::undo(undo_count, true), true);
+                history.SetText(history.GetText().substr(0, history_lengths[history_lengths.size() - undo_count]));
+                history_lengths.resize(history_lengths.size() - undo_count);
+            }
+            if(changed_code.empty()) {
+                // applied sections have only been removed - there is nothing to compile after undoing them
+                rcrl::commit_file_watches();
+                compiling_watched = false;
+            } else {
+                compiling_watched = rcrl::submit_code(changed_code);
+                if(compiling_watched)
+                    watched_code = move(changed_code);
+                else
+                    last_compiler_exitcode = 1;
+            }
+        }
+
         // if there is a spawned compiler process and it has just finished
         if(rcrl::try_get_exit_status_from_compile(last_compiler_exitcode)) {
+            active      = true;
+            time_report = rcrl::get_last_compile_time_report();
             // we can edit the code again
             editor.SetReadOnly(false);
 
             if(last_compiler_exitcode) {
                 // errors occurred - set cursor to the last line of the erroneous code
-                editor.SetCursorPosition({editor.GetTotalLines(), 0});
+                if(!compiling_watched)
+                    editor.SetCursorPosition({editor.GetTotalLines(), 0});
             } else {
                 // append to the history and focus last line
                 history.SetCursorPosition({history.GetTotalLines(), 1});
                 auto history_text = history.GetText();
+                history_lengths.push_back(history_text.size());
                 // add a new line (if one is missing) to the code that will go to the history for readability
                 if(history_text.size() && history_text.back() != '\n')
                     history_text += '\n';
                 // if the default mode was used - add an extra comment before the code to the history for clarity
-                if(used_default_mode)
-                    history_text += default_mode == rcrl::GLOBAL ? "// global\n" :
-                                                                   (default_mode == rcrl::VARS ? "// vars\n" : "// once\n");
-                history.SetText(history_text + editor.GetText());
+                if(used_default_mode && !compiling_watched)
+                    history_text += rcrl::section_directive(default_mode);
+                history.SetText(history_text + (compiling_watched ? watched_code : editor.GetText()));
 
                 // load the new plugin
                 auto output_from_loading = rcrl::copy_and_load_new_plugin(true);
-                auto old_line_count      = program_output.GetTotalLines();
-                program_output.SetText(program_output.GetText() + output_from_loading);
-                // TODO: used for auto-scroll but the cursor in the editor is removed (unfocused) sometimes from this...
-                //program_output.SetCursorPosition({program_output.GetTotalLines(), 0});
+                if(profiling)
+                    last_profile = rcrl::get_last_profile();
 
                 // highlight the new stdout lines
-                do_breakpoints_on_output(old_line_count, output_from_loading);
+                program_output.append(output_from_loading, true);
+
+                if(rcrl::get_last_load_error().size()) {
+                    // the plugin has been rejected - the code goes back to the editor to be fixed
+                    history.SetText(history_text.substr(0, history_lengths.back()));
+                    history_lengths.pop_back();
+                } else if(compiling_watched) {
+                    rcrl::commit_file_watches();
+                } else {
+                    // clear the editor
+                    editor.SetText("\r"); // an empty string "" breaks it for some reason...
+                    editor.SetCursorPosition({0, 0});
+                }
+            }
+            compiling_watched = false;
+        }
 
-                // clear the editor
-                editor.SetText("\r"); // an empty string "" breaks it for some reason...
-                editor.SetCursorPosition({0, 0});
+        // the functions by the time spent in them and the call graph - from the outermost frame
+        if(g_console_visible && profiling && last_profile.samples) {
+            ImGui::SetNextWindowPos({0.f, window_h * 0.6f}, ImGuiCond_FirstUseEver);
+            ImGui::SetNextWindowSize({window_w * 0.5f, window_h * 0.4f}, ImGuiCond_FirstUseEver);
+            if(ImGui::Begin("profiler")) {
+                ImGui::Text("%d samples (%.1f ms of CPU time) - collapsed stacks in rcrl_profile.folded",
+                            int(last_profile.samples), last_profile.samples * last_profile.interval * 1000);
+                if(last_profile.dropped)
+                    ImGui::Text("%d more samples didn't fit in the buffer (it grows for the next plugins)",
+                                int(last_profile.dropped));
+                if(ImGui::CollapsingHeader("flat", ImGuiTreeNodeFlags_DefaultOpen)) {
+                    ImGui::Text("   self   total  function");
+                    ImGui::Separator();
+                    for(const auto& entry : last_profile.flat)
+                        ImGui::Text("%6.1f%% %6.1f%%  %s", 100.0 * entry.self / last_profile.samples,
+                                    100.0 * entry.total / last_profile.samples, entry.name.c_str());
+                }
+                if(ImGui::CollapsingHeader("call graph"))
+                    draw_call_graph(last_profile.call_graph, last_profile.samples);
             }
+            ImGui::End();
+        }
+
+        if(g_console_visible && show_memory) {
+            ImGui::SetNextWindowPos({window_w * 0.5f, 0.f}, ImGuiCond_FirstUseEver);
+            ImGui::SetNextWindowSize({window_w * 0.5f, window_h * 0.4f}, ImGuiCond_FirstUseEver);
+            if(ImGui::Begin("memory", &show_memory))
+                draw_memory_dashboard();
+            ImGui::End();
+        }
+
+        // the headers to move into the precompiled header first - then the rest of the report
+        if(g_console_visible && (time_report.frontend > 0 || time_report.phases.size())) {
+            ImGui::SetNextWindowPos({window_w * 0.5f, window_h * 0.6f}, ImGuiCond_FirstUseEver);
+            ImGui::SetNextWindowSize({window_w * 0.5f, window_h * 0.4f}, ImGuiCond_FirstUseEver);
+            if(ImGui::Begin("compile time")) {
+                ImGui::Text("frontend %.1f ms, backend %.1f ms (%.1f ms in total with the build system)",
+                            time_report.frontend * 1000, time_report.backend * 1000, rcrl::get_last_compile_time() * 1000);
+                draw_compile_time_entries("move to precompiled_for_plugin.h", time_report.pch_suggestions,
+                                          ImGuiTreeNodeFlags_DefaultOpen);
+                draw_compile_time_entries("phases", time_report.phases);
+                draw_compile_time_entries("headers", time_report.headers);
+                draw_compile_time_entries("templates", time_report.templates);
+                draw_compile_time_entries("functions", time_report.functions);
+            }
+            ImGui::End();
         }
 
         // rendering
@@ -333,8 +799,9 @@ cout << vec.size() << endl;
         glLoadIdentity();
         glScalef(0.1f, 0.1f * display_w / display_h, 0.1f);
 
-        for(auto& obj : getObjects())
-            obj.draw();
+        // the simulation is advanced separately from drawing
+        updateObjects();
+        drawObjects();
 
         glPopMatrix();
 
@@ -346,10 +813,16 @@ cout << vec.size() << endl;
         // do the frame rate limiting
         this_thread::sleep_until(nextFrame);
         nextFrame += frames{1};
+
+        if(active || ImGui::IsAnyItemActive())
+            busy_frames = 3;
+        usage.add_frame(busy_frames > 0);
+        busy_frames = max(busy_frames - 1, 0);
     }
 
     // cleanup
     rcrl::cleanup_plugins();
+    rcrl::set_output_notifier(nullptr);
     ImGui_ImplGlfwGL2_Shutdown();
     ImGui::DestroyContext();
     glfwTerminate();
@@ -362,14 +835,14 @@ std::list<const char*> fragments = {
         R"raw(// global
 #include "host_app.h"
 )raw", R"raw(// vars
-auto& obj = addObject(0, -2);
+auto obj = addObject(0, -2);
 )raw", R"raw(// once
 obj.colorize(1, 1, 1);
 )raw", R"raw(// once
 obj.translate(0, -4);
 obj.set_speed(7);
 )raw", R"raw(// once
-for(auto& curr : getObjects())
+for(auto curr : getObjects())
     curr.set_speed(0.1);
 )raw", R"raw(// global
 struct MyType {
@@ -1,12 +1,23 @@
 #ifndef PRECOMPILED_FOR_PLUGIN_H
 #define PRECOMPILED_FOR_PLUGIN_H
 
+#ifdef RCRL_HEADER_UNITS
+// built once as header units by CMake (RCRL_PLUGIN_HEADER_UNITS) - keep in sync with 'plugin_header_units' there
+import <iostream>;
+import <vector>;
+import <memory>;
+import <string>;
+import <map>;
+import <functional>;
+import "host_app.h";
+#else // RCRL_HEADER_UNITS
 #include <iostream>
 #include <vector>
 #include <memory>
 #include <string>
 #include <map>
 #include <functional>
+#endif // RCRL_HEADER_UNITS
 using namespace std;
 
 #endif
@@ -4,17 +4,36 @@
 
 #include "rcrl.h"
 #include "rcrl_parser.h"
+#include "rcrl_profiler.h"
+#include "rcrl_time_report.h"
 
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
 #include <fstream>
 #include <map>
+#include <set>
 #include <cstring>
 #include <stdexcept>
 #include <algorithm>
 #include <sstream>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <atomic>
+#include <thread>
 
 #include <process.hpp>
 
+#ifdef RCRL_JIT
+#include "rcrl_jit.h"
+#endif // RCRL_JIT
+
+#ifndef RCRL_PLUGIN_WARMUP_TARGET
+#define RCRL_PLUGIN_WARMUP_TARGET RCRL_PLUGIN_NAME
+#endif // RCRL_PLUGIN_WARMUP_TARGET
+
 #ifdef _WIN32
 
 #define WIN32_LEAN_AND_MEAN
@@ -29,13 +48,49 @@ typedef HMODULE RCRL_Dynlib;
 
 #include <dlfcn.h>
 typedef void* RCRL_Dynlib;
-#define RDRL_LoadDynlib(lib) dlopen(lib, RTLD_NOW)
+#ifdef RCRL_LAZY_BINDING
+#define RCRL_DynlibBinding RTLD_LAZY
+#else // RCRL_LAZY_BINDING
+#define RCRL_DynlibBinding RTLD_NOW
+#endif // RCRL_LAZY_BINDING
+// RTLD_LOCAL - the symbols of a plugin never become part of the global lookup scope for the ones loaded after it (that
+// is already the default of glibc - not of macOS)
+#define RDRL_LoadDynlib(lib) dlopen(lib, RCRL_DynlibBinding | RTLD_LOCAL)
 #define RCRL_CloseDynlib dlclose
 #define RCRL_CopyDynlib(src, dst) (!system((string("cp ") + src + " " + dst).c_str()))
 #define RCRL_System_Delete "rm "
 
 #endif
 
+#if defined(__linux__) && !defined(RCRL_JIT)
+#include <link.h>
+#include <unistd.h>
+#endif // __linux__
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif // _WIN32
+
+// mallinfo2() - the older mallinfo() has int fields which overflow past 2 GB
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define RCRL_HEAP_STATS
+#endif // __GLIBC__
+
+// the heap blocks reachable from the persistent variables can be scanned by reading the headers of the allocator of
+// glibc (with its 64-bit layout) - not under AddressSanitizer which has an allocator of its own and poisons the headers
+#if defined(__GLIBC__) && __SIZEOF_POINTER__ == 8 && !defined(__SANITIZE_ADDRESS__)
+#define RCRL_HEAP_SCAN
+#endif // __GLIBC__
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#undef RCRL_HEAP_SCAN
+#endif // address_sanitizer
+#endif // __has_feature
+
 #ifdef _WIN32
 #define RCRL_SYMBOL_EXPORT __declspec(dllexport)
 #else
@@ -44,89 +99,316 @@ typedef void* RCRL_Dynlib;
 
 using namespace std;
 
-static map<string, void*>                   persistence;
+// a persistent variable along with the identity of the type it was created with
+struct PersistentVar
+{
+    void*  address = nullptr;
+    string type;
+    size_t size      = 0;
+    size_t layout    = 0;  // see rcrl_type_layout()
+    size_t heap_size = 0;  // see VarInfo
+    int    plugin    = -1; // the index of the plugin which created it
+};
+
+static map<string, PersistentVar>           persistence;
 static vector<pair<void*, void (*)(void*)>> deleters;
+static map<string, void (*)(void*, void*)>  migrations;         // hooks for redeclared variables - used only once
+static map<string, int>                     migration_plugins;  // the plugins which have registered the hooks
+static map<string, PersistentVar>           pending_migrations; // old objects waiting for their replacements
+static int                                  loading_plugin = -1; // the index of the plugin being loaded
+static pair<string, size_t>                 constructed_var;     // its name and the heap in use before its constructor
+static string                               load_error;          // why the plugin being loaded is rejected
+static void*                                rejected_address;    // for the objects of the redeclarations it is rejected for
+
+// the bytes of heap memory in use by the process - with the blocks allocated through mmap() (0 if not supported)
+static size_t get_heap_in_use() {
+#ifdef RCRL_HEAP_STATS
+    auto info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else  // RCRL_HEAP_STATS
+    return 0;
+#endif // RCRL_HEAP_STATS
+}
+
+// the identity of a type for the errors about redeclarations - see rcrl_type_layout()
+static string describe_type(const string& type, size_t size, size_t layout) {
+    auto out = type + ", " + to_string(size) + " bytes, alignment " + to_string(layout & 0xffff);
+    if(layout & size_t(1) << 16)
+        out += ", polymorphic";
+    if(layout & size_t(1) << 17)
+        out += ", trivially copyable";
+    if(layout & size_t(1) << 18)
+        out += ", standard layout";
+    return out;
+}
 
 // for use by the rcrl plugin
-RCRL_SYMBOL_EXPORT void*& rcrl_get_persistence(const char* var_name) { return persistence[var_name]; }
-RCRL_SYMBOL_EXPORT void   rcrl_add_deleter(void* address, void (*deleter)(void*)) { deleters.push_back({address, deleter}); }
+RCRL_SYMBOL_EXPORT void*& rcrl_get_persistence(const char* var_name, const char* type_name, size_t type_size,
+                                               size_t type_layout) {
+    auto& var = persistence[var_name];
+    if(var.address && (var.type != type_name || var.size != type_size || var.layout != type_layout)) {
+        // reinterpreting the old object with the new layout is never safe - either migrate or reject the plugin (it is
+        // unloaded right after loading it) and keep the old object - the redeclaration gets an object of its own until then
+        if(migrations.count(var_name) == 0) {
+            load_error += string("RCRL: persistent variable '") + var_name + "' redeclared with a different type (" +
+                          describe_type(var.type, var.size, var.layout) + " -> " +
+                          describe_type(type_name, type_size, type_layout) +
+                          ") - register a migration with rcrl_add_migration() or call rcrl::cleanup_plugins()\n";
+            rejected_address = nullptr;
+            return rejected_address;
+        }
+        // keep the old object aside - it is handed to the migration hook once the new one is constructed
+        pending_migrations[var_name] = var;
+        var.address                  = nullptr;
+    }
+    var.type   = type_name;
+    var.size   = type_size;
+    var.layout = type_layout;
+    // the object is constructed right after this and registered with rcrl_add_deleter()
+    if(var.address == nullptr) {
+        var.plugin      = loading_plugin;
+        constructed_var = {var_name, get_heap_in_use()};
+    }
+    return var.address;
+}
+RCRL_SYMBOL_EXPORT void rcrl_add_deleter(void* address, void (*deleter)(void*)) {
+    deleters.push_back({address, deleter});
+
+    auto var = persistence.find(constructed_var.first);
+    if(var != persistence.end() && var->second.address == address) {
+        auto heap_in_use      = get_heap_in_use();
+        var->second.heap_size = heap_in_use > constructed_var.second ? heap_in_use - constructed_var.second : 0;
+        constructed_var.first.clear();
+    }
+}
+RCRL_SYMBOL_EXPORT void rcrl_add_migration(const char* var_name, void (*migrate)(void*, void*)) {
+    migrations[var_name]        = migrate;
+    migration_plugins[var_name] = loading_plugin;
+}
+// the once and bench sections of a rejected plugin aren't executed - it is unloaded right after loading it
+RCRL_SYMBOL_EXPORT bool rcrl_is_load_rejected() { return load_error.size() != 0; }
+RCRL_SYMBOL_EXPORT void rcrl_migrate_persistence(const char* var_name, void* new_address) {
+    auto old = pending_migrations.find(var_name);
+    if(old == pending_migrations.end())
+        return;
+
+    // the hook might live in a plugin which gets unloaded later - so it is consumed here
+    auto migrate = migrations[var_name];
+    migrations.erase(var_name);
+    migration_plugins.erase(var_name);
+    migrate(old->second.address, new_address);
+
+    // destroy the old object with the deleter it was registered with - its slot is left empty so the deleters of each
+    // plugin remain a contiguous range (see undo())
+    auto deleter = find_if(deleters.begin(), deleters.end(),
+                           [&](const pair<void*, void (*)(void*)>& d) { return d.first == old->second.address; });
+    assert(deleter != deleters.end());
+    deleter->second(deleter->first);
+    *deleter = {nullptr, nullptr};
+
+    pending_migrations.erase(old);
+}
+
+// a slot of the indirection table for patchable functions
+struct PatchSlot
+{
+    atomic<void*>            function{nullptr};
+    vector<pair<int, void*>> definitions;      // with the plugins they are from - the last one is in the slot
+    int                      declared_by = -1; // the last plugin which has declared it (every plugin declares it again)
+};
+
+// keyed by the name and the type name of the signature - the nodes are never moved (the plugins keep pointers to them)
+static map<pair<string, string>, PatchSlot> patch_slots;
+
+// for use by the rcrl plugin
+RCRL_SYMBOL_EXPORT atomic<void*>* rcrl_get_patch_slot(const char* name, const char* type_name) {
+    auto& slot = patch_slots[{name, type_name}];
+    // the namespace isn't a part of the key - so the same name and signature in 2 namespaces would share a slot
+    if(loading_plugin != -1 && slot.declared_by == loading_plugin)
+        load_error += string("RCRL: patchable function '") + name + "' (" + type_name +
+                      ") declared more than once - the names of patchable functions should be unique across namespaces\n";
+    slot.declared_by = loading_plugin;
+    return &slot.function;
+}
+RCRL_SYMBOL_EXPORT void rcrl_define_patch(const char* name, const char* type_name, void* function, bool new_code) {
+    // every plugin defines the functions from the sections compiled before it again - those don't take over the slot
+    auto& slot = patch_slots[{name, type_name}];
+    if(!new_code && slot.definitions.size())
+        return;
+    slot.definitions.push_back({loading_plugin, function});
+    slot.function.store(function, memory_order_release);
+}
 
 namespace rcrl
 {
+// see set_output_notifier()
+static atomic<void (*)()> output_notifier(nullptr);
+
+static void notify_output() {
+    if(auto notifier = output_notifier.load())
+        notifier();
+}
+
+// blocks until the process exits - without reaping it so its exit status is still there for try_get_exit_status()
+static void watch_for_exit(TinyProcessLib::Process::id_type id) {
+#ifdef _WIN32
+    if(HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, id)) {
+        WaitForSingleObject(process, INFINITE);
+        CloseHandle(process);
+    }
+#else  // _WIN32
+    // fails right away if the process has already been reaped
+    siginfo_t info;
+    while(waitid(P_PID, id, &info, WEXITED | WNOWAIT) == -1 && errno == EINTR)
+        ;
+#endif // _WIN32
+    notify_output();
+}
+
+// a build with a thread which notifies the host when it exits - destroyed only after the process has exited
+struct BuildProcess : TinyProcessLib::Process
+{
+    thread exit_watcher;
+
+    BuildProcess(const string& command, function<void(const char*, size_t)> output)
+            : Process(command, "", output, output)
+            , exit_watcher(watch_for_exit, get_id()) {}
+    ~BuildProcess() { exit_watcher.join(); }
+};
+
+// a loaded plugin and where its part of the state starts - the rest of it is up to where the next plugin's part starts
+struct LoadedPlugin
+{
+    PluginInfo  info;
+    RCRL_Dynlib dynlib;
+    size_t      first_deleter; // in deleters
+    size_t      first_section; // in compiled_sections
+};
+
 // global state
-static vector<pair<string, RCRL_Dynlib>>   plugins;
-static unique_ptr<TinyProcessLib::Process> compiler_process;
-static string                              compiler_output;
-static mutex                               compiler_output_mut;
-static bool                                last_compile_successful = false;
+static vector<LoadedPlugin>                  plugins;
+static unique_ptr<BuildProcess>              compiler_process;
+static string                                compiler_output;
+static string                                compile_log; // all output of the current compilation - for get_batch_results()
+static mutex                                 compiler_output_mut;
+static vector<string>                        batch_names; // the names of the snippets from the last submit_batch()
+static size_t                                submission_count = 0; // copied plugins since the last cleanup (even undone)
+static bool                                  last_compile_successful = false;
+static chrono::steady_clock::time_point      compile_start;
+static double                                last_compile_time = 0;
+static bool                                  unload_once_only_plugins = false;
+static pair<string, Mode>                    speculation_after_load;   // started by the next copy_and_load_new_plugin()
+static int                                   profiling_frequency = 0;  // 0 when not profiling
+static double                                max_profile_seconds = 60; // see set_profiling()
+static function<void()>                      plugin_barrier;           // empty if none has been set
+static Profile                               last_profile;
+static CompileTimeReport                     last_time_report;
+static vector<int>                           checkpoints;        // pipes to the frozen processes - the latest is last
+static string                                rolled_back_output; // compiler output carried over from a rollback
 // holds code only for global and vars sections which have already been successfully compiled and loaded
 static vector<string> compiled_sections;
 // holds all the sections which were last submitted for compilation - on success and if the
 // new plugin is loaded global and vars sections will be put in the compiled_sections list
 static vector<pair<string, Mode>> uncompiled_sections;
 
+// the sections of submitted code - for translating the locations in diagnostics which refer to the #line directives
+struct SourceMapEntry
+{
+    size_t                     submission = 0;
+    vector<pair<size_t, Mode>> sections; // the lines at which they begin and their modes
+};
+// keyed by the file names used in the #line directives
+static map<string, SourceMapEntry> source_map;
+
+// a build in the background which isn't a submission - a warm-up or a speculative compilation of code
+static unique_ptr<BuildProcess>            background_process;
+static string                              background_source;          // the plugin source - empty for a warm-up
+static string                              background_output;          // buffered until adopted by submit_code()
+static bool                                background_adopted = false; // guarded by compiler_output_mut
+
 // called asynchronously by the compilation process
 void output_appender(const char* bytes, size_t n) {
-    lock_guard<mutex> lock(compiler_output_mut);
-    compiler_output += string(bytes, n);
+    {
+        lock_guard<mutex> lock(compiler_output_mut);
+        compiler_output += string(bytes, n);
+        compile_log += string(bytes, n);
+    }
+    notify_output();
 }
 
-std::string cleanup_plugins(bool redirect_stdout) {
-    assert(!is_compiling());
-
-    if(redirect_stdout)
-        freopen(RCRL_BUILD_FOLDER "/rcrl_stdout.txt", "w", stdout);
-
-    // call the deleters in reverse order
-    for(auto it = deleters.rbegin(); it != deleters.rend(); ++it)
-        it->second(it->first);
-    deleters.clear();
-
-    // clear the code sections and pointers to globals
-    compiled_sections.clear();
-    persistence.clear();
-
-    // close the plugins in reverse order
-    for(auto it = plugins.rbegin(); it != plugins.rend(); ++it)
-        RCRL_CloseDynlib(it->second);
-
-    string out;
+static void clear_compile_log() {
+    lock_guard<mutex> lock(compiler_output_mut);
+    compile_log.clear();
+}
 
-    if(redirect_stdout) {
-        fclose(stdout);
-        freopen("CON", "w", stdout);
+// called asynchronously by the background build - the output becomes visible only if the build is adopted
+static void background_output_appender(const char* bytes, size_t n) {
+    lock_guard<mutex> lock(compiler_output_mut);
+    (background_adopted ? compiler_output : background_output) += string(bytes, n);
+    if(background_adopted) {
+        compile_log += string(bytes, n);
+        notify_output();
+    }
+}
 
-        FILE* f = fopen(RCRL_BUILD_FOLDER "/rcrl_stdout.txt", "rb");
-        fseek(f, 0, SEEK_END);
-        long fsize = ftell(f);
-        fseek(f, 0, SEEK_SET);
+// spawns the build system for a target related to the plugin in a non-blocking way
+static BuildProcess* spawn_build(const string& target, function<void(const char*, size_t)> output) {
+#ifdef RCRL_TIME_TRACE_FILE
+    // a failed build might not write a new trace - the old one shouldn't be reported for it
+    remove(RCRL_TIME_TRACE_FILE);
+#endif // RCRL_TIME_TRACE_FILE
+    return new BuildProcess("cmake --build " RCRL_BUILD_FOLDER " --target " + target
+#ifdef RCRL_CONFIG
+                                    + " --config " RCRL_CONFIG
+#endif // multi config IDE
+#if defined(RCRL_CONFIG) && defined(_MSC_VER)
+                                    + " -- /verbosity:quiet"
+#endif // Visual Studio
+                            ,
+                            output);
+}
 
-        out.resize(fsize);
-        fread((void*)out.data(), fsize, 1, f);
-        fclose(f);
+// stops the background build (if any) and waits for it so it doesn't interfere with a real one
+static void cancel_background_build() {
+#ifdef RCRL_JIT
+    jit::wait_for_warmup();
+#else  // RCRL_JIT
+    if(background_process) {
+        int exitcode;
+        if(!background_process->try_get_exit_status(exitcode)) {
+            background_process->kill(true);
+            background_process->get_exit_status();
+        }
+        background_process.reset();
     }
+    background_source.clear();
+    background_output.clear();
+#endif // RCRL_JIT
+}
 
-    string bin_folder(RCRL_BIN_FOLDER);
-#ifdef _WIN32
-    // replace forward slash with windows style slash
-    replace(bin_folder.begin(), bin_folder.end(), '/', '\\');
-#endif // _WIN32
+#ifndef RCRL_JIT
+// writes the plugin source and starts building it in the background - speculative builds can later be adopted
+static void start_background_build(const string& source, const string& target, bool speculative) {
+    cancel_background_build();
 
-    if(plugins.size())
-        system((string(RCRL_System_Delete) + bin_folder + RCRL_PLUGIN_NAME "_*" RCRL_EXTENSION).c_str());
-    plugins.clear();
+    ofstream myfile(RCRL_PLUGIN_FILE);
+    myfile << source;
+    myfile.close();
 
-    return out;
+    {
+        lock_guard<mutex> lock(compiler_output_mut);
+        background_adopted = false;
+    }
+    background_source  = speculative ? source : string();
+    background_process = unique_ptr<BuildProcess>(spawn_build(target, background_output_appender));
 }
+#endif // RCRL_JIT
 
-bool submit_code(string code, Mode default_mode, bool* used_default_mode) {
-    assert(!is_compiling());
-    assert(code.size());
-
-    // if this is the first piece of code submitted
-    if(compiled_sections.size() == 0)
-        compiled_sections.push_back("#include \"rcrl/rcrl_for_plugin.h\"\n");
-
+// turns the submitted code into sections for the plugin - vars sections are transformed into RCRL_VAR macros:
+// - returns false on parse errors - they are reported through the compiler output only if requested
+// if a file name is given the sections get #line directives with it - so diagnostics point to the original code
+static bool generate_sections(string code, Mode default_mode, bool* used_default_mode, vector<pair<string, Mode>>& sections,
+                              bool report_errors, const string& file = string()) {
     // fix line endings
     replace(code.begin(), code.end(), '\r', '\n');
 
@@ -134,7 +416,9 @@ bool submit_code(string code, Mode default_mode, bool* used_default_mode) {
     auto section_beginings = parse_sections_and_remove_comments(code, default_mode);
 
     // fill the current sections of code for compilation
-    uncompiled_sections.clear();
+    sections.clear();
+    SourceMapEntry source_map_entry;
+    source_map_entry.submission = submission_count + 1;
     for(auto it = section_beginings.begin(); it != section_beginings.end(); ++it) {
         // get the code
         string section_code =
@@ -148,8 +432,25 @@ bool submit_code(string code, Mode default_mode, bool* used_default_mode) {
         if(section_code.back() != '\n')
             section_code.push_back('\n');
 
+        // the code of a section begins with the (now empty) line of its directive - except for the first one
+        auto line_directive = [&](size_t line) {
+            return file.size() ? "#line " + to_string(line) + " \"" + file + "\"\n" : string();
+        };
+        // sections with nothing but whitespace don't count - such as before the first directive
+        if(section_code.find_first_not_of(" \t\n\v\f\r") != string::npos)
+            source_map_entry.sections.push_back({it->line, it->mode});
+
+        if(it->mode == GLOBAL)
+            section_code = line_directive(it->line) + section_code;
+
         if(it->mode == ONCE)
-            section_code = "RCRL_ONCE_BEGIN\n" + section_code + "RCRL_ONCE_END\n";
+            section_code = "RCRL_ONCE_BEGIN\n" + line_directive(it->line) + section_code + "RCRL_ONCE_END\n";
+
+        // the results are reported with the location of the section
+        if(it->mode == BENCH)
+            section_code = "RCRL_BENCH_BEGIN(\"" + (file.size() ? file : string("bench")) + ":" + to_string(it->line) +
+                           "\")\n" + line_directive(it->line) + section_code + "RCRL_BENCH_END\n";
+
 
         if(it->mode == VARS) {
             try {
@@ -157,6 +458,8 @@ bool submit_code(string code, Mode default_mode, bool* used_default_mode) {
                 section_code.clear();
 
                 for(const auto& var : vars) {
+                    // each variable is on a line of its own in the generated code
+                    section_code += line_directive(var.line);
                     if(var.type == "auto" || var.type == "const auto") {
                         section_code += (var.is_reference ? "RCRL_VAR_AUTO_REF(" : "RCRL_VAR_AUTO(") + var.name + ", " +
                                         (var.type == "auto" ? "RCRL_EMPTY()" : "const") + ", " +
@@ -168,105 +471,1010 @@ bool submit_code(string code, Mode default_mode, bool* used_default_mode) {
                     }
                 }
             } catch(exception& e) {
-                output_appender(e.what(), strlen(e.what()));
-                uncompiled_sections.clear();
+                if(report_errors) {
+                    auto msg = (file.size() ? file + ": " : string()) + e.what();
+                    output_appender(msg.data(), msg.size());
+                }
+                sections.clear();
                 return false;
             }
         }
 
         // push the section code to the list of uncompiled ones
-        uncompiled_sections.push_back({section_code, it->mode});
+        sections.push_back({section_code, it->mode});
     }
+    if(file.size())
+        source_map[file] = source_map_entry;
+    return true;
+}
 
-    // concatenate all the sections to make the source file to be compiled
-    ofstream myfile(RCRL_PLUGIN_FILE);
+// rewrites the locations in diagnostics which refer to submitted code (through the #line directives) so they include the
+// submission and the section - "submission_3:5:7: error" becomes "submission 3, once section 2, line 5:7: error"
+static string translate_diagnostics(const string& text) {
+    string             out;
+    istringstream      in(text);
+    static const char* mode_names[] = {"global", "vars", "once", "bench"};
+    for(string line; getline(in, line);) {
+        // the file names are at the begining of the lines
+        auto entry = source_map.end();
+        for(auto it = source_map.begin(); it != source_map.end(); ++it)
+            if(line.compare(0, it->first.size() + 1, it->first + ":") == 0 &&
+               (entry == source_map.end() || it->first.size() > entry->first.size()))
+                entry = it;
+
+        if(entry == source_map.end()) {
+            out += line + "\n";
+            continue;
+        }
+
+        const auto& file        = entry->first;
+        auto        submission  = to_string(entry->second.submission);
+        auto        description = file == "submission_" + submission ? "submission " + submission :
+                                                                       file + " (submission " + submission + ")";
+
+        // the line number (if any) determines the section
+        size_t pos       = file.size() + 1;
+        size_t user_line = 0;
+        while(pos < line.size() && isdigit(line[pos]))
+            user_line = user_line * 10 + (line[pos++] - '0');
+        if(user_line == 0 || pos >= line.size() || line[pos] != ':') {
+            out += description + line.substr(file.size()) + "\n";
+            continue;
+        }
+
+        size_t section = 0;
+        while(section + 1 < entry->second.sections.size() && entry->second.sections[section + 1].first <= user_line)
+            ++section;
+        if(section < entry->second.sections.size())
+            description += string(", ") + mode_names[entry->second.sections[section].second] + " section " +
+                           to_string(section + 1);
+        out += description + ", line " + to_string(user_line) + line.substr(pos) + "\n";
+    }
+    // keep the lack of a new line at the end
+    if(text.size() && text.back() != '\n' && out.size())
+        out.pop_back();
+    return out;
+}
+
+// the full source of a plugin with the given new sections on top of everything compiled so far
+static string make_plugin_source(const vector<pair<string, Mode>>& sections) {
+    string source;
+    size_t lines   = 0;
+    bool   renamed = false;
+    auto   append  = [&](const string& section) {
+        // the sections after ones with #line directives continue with the real lines of the plugin source
+        if(renamed && section.find("#line ") == string::npos) {
+            source += "#line " + to_string(lines + 2) + " \"" RCRL_PLUGIN_FILE "\"\n";
+            ++lines;
+        }
+        source += section;
+        lines += count(section.begin(), section.end(), '\n');
+        renamed = section.find("#line ") != string::npos;
+    };
+
+    // see RCRL_NEW_CODE in rcrl_for_plugin.h
+    append("#undef RCRL_NEW_CODE\n#define RCRL_NEW_CODE 0\n");
+    for(const auto& section : compiled_sections)
+        append(section);
+    append("#undef RCRL_NEW_CODE\n#define RCRL_NEW_CODE 1\n");
+    for(const auto& section : sections)
+        append(section.first);
+    return source;
+}
+
+#ifdef RCRL_TIME_REPORT
+// the report for the compilation which just finished - from its output and the trace written by Clang (if any)
+static CompileTimeReport build_time_report() {
+    // the headers included by the global sections as spelled - those in the precompiled header are no news
+    vector<string> includes;
+    auto           add_includes = [&](const string& code) {
+        istringstream in(code);
+        for(string line; getline(in, line);) {
+            auto hash = line.find_first_not_of(" \t");
+            if(hash == string::npos || line[hash] != '#')
+                continue;
+            auto directive = line.find_first_not_of(" \t", hash + 1);
+            if(directive == string::npos || line.compare(directive, 7, "include") != 0)
+                continue;
+            auto begin = line.find_first_of("<\"", directive + 7);
+            auto end   = begin == string::npos ? begin : line.find(line[begin] == '<' ? '>' : '"', begin + 1);
+            if(end == string::npos)
+                continue;
+            auto include = line.substr(begin, end - begin + 1);
+            if(include.compare(1, 5, "rcrl/") != 0 && include.find("precompiled_for_plugin.h") == string::npos)
+                includes.push_back(include);
+        }
+    };
     for(const auto& section : compiled_sections)
-        myfile << section;
+        add_includes(section);
     for(const auto& section : uncompiled_sections)
-        myfile << section.first;
-    myfile.close();
+        if(section.second == GLOBAL)
+            add_includes(section.first);
+
+#ifdef RCRL_TIME_TRACE_FILE
+    ifstream trace_file(RCRL_TIME_TRACE_FILE, ios::binary);
+    string   trace((istreambuf_iterator<char>(trace_file)), istreambuf_iterator<char>());
+#else  // RCRL_TIME_TRACE_FILE
+    string trace;
+#endif // RCRL_TIME_TRACE_FILE
+
+    lock_guard<mutex> lock(compiler_output_mut);
+    return time_report::build(compile_log, trace, includes);
+}
+#endif // RCRL_TIME_REPORT
+
+#ifndef RCRL_JIT
+// the size of a file on disk
+static size_t get_file_size(const string& path) {
+    ifstream file(path, ios::binary | ios::ate);
+    return file ? size_t(file.tellg()) : 0;
+}
+
+// the address ranges of the loadable segments of a loaded shared object (empty if not supported)
+static vector<pair<uintptr_t, uintptr_t>> get_mapped_segments(const string& path) {
+    pair<const string*, vector<pair<uintptr_t, uintptr_t>>> data = {&path, {}};
+#ifdef __linux__
+    dl_iterate_phdr(
+            [](dl_phdr_info* info, size_t, void* user_data) {
+                auto& data = *static_cast<pair<const string*, vector<pair<uintptr_t, uintptr_t>>>*>(user_data);
+                if(info->dlpi_name == nullptr || *data.first != info->dlpi_name)
+                    return 0;
+                for(int i = 0; i < info->dlpi_phnum; ++i) {
+                    const auto& segment = info->dlpi_phdr[i];
+                    if(segment.p_type == PT_LOAD) {
+                        auto begin = (info->dlpi_addr + segment.p_vaddr) / segment.p_align * segment.p_align;
+                        auto end   = (info->dlpi_addr + segment.p_vaddr + segment.p_memsz + segment.p_align - 1) /
+                                   segment.p_align * segment.p_align;
+                        data.second.push_back({begin, end});
+                    }
+                }
+                return 1;
+            },
+            &data);
+#endif // __linux__
+    return data.second;
+}
+
+// the resident memory of the process in bytes (0 if not supported)
+static size_t get_resident_memory() {
+    long resident = 0;
+#ifdef __linux__
+    long  pages = 0;
+    FILE* f     = fopen("/proc/self/statm", "r");
+    if(f) {
+        if(fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(f);
+    }
+    resident *= sysconf(_SC_PAGESIZE);
+#endif // __linux__
+    return size_t(resident);
+}
+
+// the number of threads of the process (0 if not supported)
+static int get_thread_count() {
+    int threads = 0;
+#ifdef __linux__
+    ifstream status("/proc/self/status");
+    string   line;
+    while(getline(status, line))
+        if(line.compare(0, 8, "Threads:") == 0)
+            threads = atoi(line.c_str() + 8);
+#endif // __linux__
+    return threads;
+}
+
+#ifdef RCRL_HEAP_SCAN
+// the most heap blocks scanned for pointers into a plugin - a persistent variable with a bigger graph behind it keeps
+// the plugin loaded instead of making every submission cost as much as walking it
+static const size_t max_scanned_heap_blocks = 1 << 16;
+
+// if malloc() is the one of glibc - and not one which replaces it (jemalloc, tcmalloc) with blocks of another layout
+static bool uses_glibc_malloc() {
+    static const bool result = []() {
+        Dl_info info;
+        auto    address = dlsym(RTLD_DEFAULT, "malloc");
+        return address && dladdr(address, &info) && info.dli_fname && strstr(info.dli_fname, "libc.so");
+    }();
+    return result;
+}
+
+// the address ranges of the mappings of the process where the allocator of glibc puts its blocks - the main heap and
+// the anonymous readable and writable ones (the other arenas and the big blocks allocated with mmap()) - sorted
+static vector<pair<uintptr_t, uintptr_t>> get_heap_mappings() {
+    vector<pair<uintptr_t, uintptr_t>> mappings;
+    ifstream                           maps("/proc/self/maps");
+    string                             line;
+    while(getline(maps, line)) {
+        unsigned long begin = 0, end = 0;
+        char          permissions[5] = {};
+        int           path           = 0;
+        if(sscanf(line.c_str(), "%lx-%lx %4s %*s %*s %*s %n", &begin, &end, permissions, &path) == 3 && path &&
+           permissions[0] == 'r' && permissions[1] == 'w' &&
+           (line.compare(path, string::npos, "") == 0 || line.compare(path, string::npos, "[heap]") == 0))
+            mappings.push_back({begin, end});
+    }
+    return mappings;
+}
+
+// the range of the heap block (of the allocator of glibc) which starts at the given address - empty if it doesn't look
+// like one: the size of a block is stored right before it with flags in the lowest 3 bits (2 - allocated with mmap())
+// and the lowest bit of the size of the next block is set while the block is in use
+static pair<uintptr_t, uintptr_t> get_heap_block(uintptr_t address, const vector<pair<uintptr_t, uintptr_t>>& mappings) {
+    if(address % 16 != 0)
+        return {0, 0};
+    auto mapping = upper_bound(mappings.begin(), mappings.end(), make_pair(address, ~uintptr_t(0)));
+    if(mapping == mappings.begin() || address - 16 < (--mapping)->first || address >= mapping->second)
+        return {0, 0};
+
+    auto size_field = *reinterpret_cast<const uintptr_t*>(address - 8);
+    auto size       = size_field & ~uintptr_t(7);
+    auto block      = address - 16;
+    if(size < 32 || size % 16 != 0 || size > mapping->second - block)
+        return {0, 0};
+    if(size_field & 2)
+        return {address, block + size};
+    if(size + 16 > mapping->second - block || !(*reinterpret_cast<const uintptr_t*>(block + size + 8) & 1))
+        return {0, 0};
+    return {address, block + size + 8}; // the first word of the next block is a part of this one while it is in use
+}
+#endif // RCRL_HEAP_SCAN
+
+// checks if any of the persistent variables holds a pointer into the given address ranges - a lambda, a function or
+// anything else from a plugin that escaped into the persistent state. The heap blocks reachable from them are scanned
+// as well (a lambda pushed into a persistent vector) - found by looking for words which point to the start of one so
+// the scan errs on the side of keeping the plugin (the unused capacity of a container counts too). Without the
+// allocator of glibc that can't be done and the answer is always yes - as it is for more than max_scanned_heap_blocks
+// blocks. Pointers stored anywhere else (in the state of the host) aren't looked for
+static bool persistence_points_into(const vector<pair<uintptr_t, uintptr_t>>& segments) {
+#ifdef RCRL_HEAP_SCAN
+    if(!uses_glibc_malloc())
+        return true;
+
+    vector<pair<uintptr_t, uintptr_t>> to_scan;
+    for(const auto& var : persistence)
+        if(var.second.address)
+            to_scan.push_back({uintptr_t(var.second.address), uintptr_t(var.second.address) + var.second.size});
+    auto           mappings = get_heap_mappings();
+    set<uintptr_t> visited;
+    for(const auto& range : to_scan)
+        visited.insert(range.first);
+
+    while(to_scan.size()) {
+        auto range = to_scan.back();
+        to_scan.pop_back();
+        for(auto word = reinterpret_cast<const uintptr_t*>(range.first);
+            word + 1 <= reinterpret_cast<const uintptr_t*>(range.second); ++word) {
+            for(const auto& segment : segments)
+                if(*word >= segment.first && *word < segment.second)
+                    return true;
+            auto block = get_heap_block(*word, mappings);
+            if(block.second && visited.insert(block.first).second) {
+                if(visited.size() > max_scanned_heap_blocks)
+                    return true;
+                to_scan.push_back(block);
+            }
+        }
+    }
+    return false;
+#else  // RCRL_HEAP_SCAN
+    (void)segments;
+    return true;
+#endif // RCRL_HEAP_SCAN
+}
+#endif // RCRL_JIT
+
+// restores stdout after it has been redirected to rcrl_stdout.txt - and returns what has been written to it
+static string restore_stdout() {
+    fclose(stdout);
+    freopen("CON", "w", stdout);
+
+    FILE* f = fopen(RCRL_BUILD_FOLDER "/rcrl_stdout.txt", "rb");
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    string out;
+    out.resize(fsize);
+    fread((void*)out.data(), fsize, 1, f);
+    fclose(f);
+    return out;
+}
+
+bool is_jit_backend() {
+#ifdef RCRL_JIT
+    return true;
+#else  // RCRL_JIT
+    return false;
+#endif // RCRL_JIT
+}
+
+std::string cleanup_plugins(bool redirect_stdout) {
+    assert(!is_compiling());
+
+    cancel_background_build();
+
+    if(redirect_stdout)
+        freopen(RCRL_BUILD_FOLDER "/rcrl_stdout.txt", "w", stdout);
+
+    // whatever the plugins have started should finish while their code and the persistent variables are still there
+    if(plugin_barrier)
+        plugin_barrier();
+
+    // call the deleters in reverse order
+    for(auto it = deleters.rbegin(); it != deleters.rend(); ++it)
+        if(it->second)
+            it->second(it->first);
+    deleters.clear();
+
+    // clear the code sections and pointers to globals
+    compiled_sections.clear();
+    persistence.clear();
+    patch_slots.clear();
+    migrations.clear();
+    migration_plugins.clear();
+    pending_migrations.clear();
+    constructed_var.first.clear();
+    load_error.clear();
+    speculation_after_load.first.clear();
+    source_map.clear();
+    submission_count = 0;
+
+#ifdef RCRL_JIT
+    // all JIT-ed code goes away with the interpreter
+    jit::reset();
+#else  // RCRL_JIT
+    // close the plugins in reverse order
+    for(auto it = plugins.rbegin(); it != plugins.rend(); ++it)
+        if(it->dynlib)
+            RCRL_CloseDynlib(it->dynlib);
+#endif // RCRL_JIT
 
+    string out;
+
+    if(redirect_stdout)
+        out = restore_stdout();
+
+    string bin_folder(RCRL_BIN_FOLDER);
+#ifdef _WIN32
+    // replace forward slash with windows style slash
+    replace(bin_folder.begin(), bin_folder.end(), '/', '\\');
+#endif // _WIN32
+
+#ifndef RCRL_JIT
+    if(plugins.size())
+        system((string(RCRL_System_Delete) + bin_folder + RCRL_PLUGIN_NAME "_*" RCRL_EXTENSION).c_str());
+#endif // RCRL_JIT
+    plugins.clear();
+
+    return out;
+}
+
+#ifndef RCRL_JIT
+// unloads the last n plugins and forgets everything from them - see rcrl::undo() (also for a rejected plugin)
+static void unload_last_plugins(size_t n) {
+    // a build which hasn't been loaded yet (or a speculative one) is for code on top of these plugins
+    cancel_background_build();
+    last_compile_successful = false;
+
+    if(plugin_barrier)
+        plugin_barrier();
+
+    auto first_plugin  = plugins.size() - n;
+    auto first_deleter = plugins[first_plugin].first_deleter;
+
+    // call the deleters registered while loading them in reverse order
+    for(auto i = deleters.size(); i-- > first_deleter;)
+        if(deleters[i].second)
+            deleters[i].second(deleters[i].first);
+    deleters.resize(first_deleter);
+
+    // forget their sections, their variables and the migration hooks from them
+    compiled_sections.resize(plugins[first_plugin].first_section);
+    for(auto it = persistence.begin(); it != persistence.end();)
+        it = it->second.plugin >= int(first_plugin) ? persistence.erase(it) : next(it);
+    for(auto it = migration_plugins.begin(); it != migration_plugins.end();) {
+        if(it->second >= int(first_plugin)) {
+            migrations.erase(it->first);
+            it = migration_plugins.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // the functions redefined by them go back to the previous definitions
+    for(auto it = patch_slots.begin(); it != patch_slots.end();) {
+        auto& definitions = it->second.definitions;
+        while(definitions.size() && definitions.back().first >= int(first_plugin))
+            definitions.pop_back();
+        if(it->second.declared_by >= int(first_plugin))
+            it->second.declared_by = -1;
+        if(definitions.empty()) {
+            // defined first by one of them - so nothing else calls it
+            it = patch_slots.erase(it);
+        } else {
+            it->second.function.store(definitions.back().second, memory_order_release);
+            ++it;
+        }
+    }
+
+    // close them in reverse order and delete their copies
+    for(auto i = plugins.size(); i-- > first_plugin;) {
+        if(plugins[i].dynlib) {
+            RCRL_CloseDynlib(plugins[i].dynlib);
+            remove(plugins[i].info.name.c_str());
+        }
+    }
+    plugins.erase(plugins.begin() + first_plugin, plugins.end());
+}
+#endif // RCRL_JIT
+
+std::string undo(size_t n, bool redirect_stdout) {
+    assert(!is_compiling());
+    assert(!is_jit_backend());
+    assert(n <= plugins.size());
+
+#ifdef RCRL_JIT
+    (void)n;
+    (void)redirect_stdout;
+    return "";
+#else  // RCRL_JIT
+    if(n == 0)
+        return "";
+
+    if(redirect_stdout)
+        freopen(RCRL_BUILD_FOLDER "/rcrl_stdout.txt", "w", stdout);
+
+    unload_last_plugins(n);
+
+    string out;
+
+    if(redirect_stdout)
+        out = restore_stdout();
+
+    return out;
+#endif // RCRL_JIT
+}
+
+// the file name in the #line directives for the next submission - speculative builds for it use the same name
+static string submission_name() { return "submission_" + to_string(submission_count + 1); }
+
+// starts compiling the uncompiled sections - what submit_code() and submit_batch() have in common
+static void start_compile() {
     // mark the successful compilation flag as false
     last_compile_successful = false;
 
     compiler_output.clear();
-    compiler_process = unique_ptr<TinyProcessLib::Process>(
-            new TinyProcessLib::Process("cmake --build " RCRL_BUILD_FOLDER " --target " RCRL_PLUGIN_NAME
-#ifdef RCRL_CONFIG
-                                        " --config " RCRL_CONFIG
-#endif // multi config IDE
-#if defined(RCRL_CONFIG) && defined(_MSC_VER)
-                                        " -- /verbosity:quiet"
-#endif // Visual Studio
-                                        ,
-                                        "", output_appender, output_appender));
+    compile_start = chrono::steady_clock::now();
+
+#ifdef RCRL_JIT
+    // the real build takes precedence over the warm-up
+    cancel_background_build();
+
+    // the interpreter already knows about everything compiled so far - only the new sections are sent
+    string code_for_jit;
+    for(const auto& section : uncompiled_sections)
+        code_for_jit += section.first;
+    jit::submit(code_for_jit, output_appender, notify_output);
+#else  // RCRL_JIT
+    // concatenate all the sections to make the source file to be compiled
+    auto source = make_plugin_source(uncompiled_sections);
+
+    // the same code is already being compiled (or is done) speculatively - take over that build instead of starting over
+    if(background_process && background_source == source) {
+        lock_guard<mutex> lock(compiler_output_mut);
+        compiler_output    = move(background_output);
+        compile_log        = compiler_output;
+        background_adopted = true;
+        compiler_process   = move(background_process);
+        background_source.clear();
+        background_output.clear();
+        return;
+    }
+
+    // the real build takes precedence over the warm-up and over speculation for different code
+    cancel_background_build();
+
+    ofstream myfile(RCRL_PLUGIN_FILE);
+    myfile << source;
+    myfile.close();
+
+    compiler_process = unique_ptr<BuildProcess>(spawn_build(RCRL_PLUGIN_NAME, output_appender));
+#endif // RCRL_JIT
+}
+
+bool submit_code(string code, Mode default_mode, bool* used_default_mode) {
+    assert(!is_compiling());
+    assert(code.size());
+
+    // if this is the first piece of code submitted
+    if(compiled_sections.size() == 0)
+        compiled_sections.push_back("#include \"rcrl/rcrl_for_plugin.h\"\n");
+
+    clear_compile_log();
+    batch_names.clear();
+    if(!generate_sections(move(code), default_mode, used_default_mode, uncompiled_sections, true, submission_name()))
+        return false;
 
+    start_compile();
     return true;
 }
 
-string get_new_compiler_output() {
+bool submit_batch(const vector<Snippet>& snippets) {
+    assert(!is_compiling());
+    assert(snippets.size());
+
+    if(compiled_sections.size() == 0)
+        compiled_sections.push_back("#include \"rcrl/rcrl_for_plugin.h\"\n");
+
+    clear_compile_log();
+    batch_names.clear();
+    uncompiled_sections.clear();
+
+    // static initialization within a translation unit follows the order of definition so all snippets can go in a
+    // single plugin and their once and vars sections are still executed in order
+    vector<pair<string, Mode>> sections;
+    bool                       parsed = true;
+    for(size_t i = 0; i < snippets.size(); ++i) {
+        batch_names.push_back(snippets[i].name.size() ? snippets[i].name : "snippet_" + to_string(i + 1));
+        // all snippets are parsed so the parse errors from all of them are reported
+        if(!generate_sections(snippets[i].code, snippets[i].default_mode, nullptr, sections, true, batch_names.back()))
+            parsed = false;
+        uncompiled_sections.insert(uncompiled_sections.end(), sections.begin(), sections.end());
+    }
+    if(!parsed) {
+        uncompiled_sections.clear();
+        return false;
+    }
+
+    start_compile();
+    return true;
+}
+
+// if a line of compiler output reports an error - and isn't a warning, a note or a quoted line of code which only mentions
+// one: GCC/Clang and MSVC diagnostics, undefined references from the linker (which refer to the lines of the code too)
+// and the errors of the parser of rcrl
+static bool is_error_line(const string& line) {
+    for(auto marker : {": error:", ": fatal error", ": error C", ": error LNK", ": undefined reference to", ": parse error"})
+        if(line.find(marker) != string::npos)
+            return true;
+    return false;
+}
+
+vector<SnippetResult> get_batch_results() {
+    vector<SnippetResult> results;
+    for(const auto& name : batch_names)
+        results.push_back({name, false, ""});
+
     lock_guard<mutex> lock(compiler_output_mut);
-    auto              temp = compiler_output;
-    compiler_output.clear();
-    return temp;
+    // a diagnostic begins with the file name (from the #line directives) followed by ':' (or by '(' with MSVC) and continues
+    // with the indented lines after it
+    SnippetResult* current = nullptr;
+#ifdef RCRL_TIME_REPORT
+    istringstream log(time_report::remove_report(compile_log));
+#else  // RCRL_TIME_REPORT
+    istringstream log(compile_log);
+#endif // RCRL_TIME_REPORT
+    for(string line; getline(log, line);) {
+        if(line.empty() || !isspace(line[0]))
+            current = nullptr;
+        for(auto& result : results)
+            if(line.compare(0, result.name.size(), result.name) == 0 && line.size() > result.name.size() &&
+               (line[result.name.size()] == ':' || line[result.name.size()] == '('))
+                current = &result;
+        if(current) {
+            current->diagnostics += line + "\n";
+            current->has_errors |= is_error_line(line);
+        }
+    }
+    return results;
+}
+
+bool speculate_code(string code, Mode default_mode) {
+    assert(!is_compiling());
+    assert(!is_jit_backend());
+    assert(code.size());
+
+#ifdef RCRL_JIT
+    (void)code;
+    (void)default_mode;
+    return false;
+#else  // RCRL_JIT
+    if(compiled_sections.size() == 0)
+        compiled_sections.push_back("#include \"rcrl/rcrl_for_plugin.h\"\n");
+
+    vector<pair<string, Mode>> sections;
+    if(!generate_sections(move(code), default_mode, nullptr, sections, false, submission_name()))
+        return false;
+
+    auto source = make_plugin_source(sections);
+    if(!background_process || background_source != source)
+        start_background_build(source, RCRL_PLUGIN_NAME, true);
+    return true;
+#endif // RCRL_JIT
+}
+
+void speculate_code_after_load(string code, Mode default_mode) {
+    assert(!is_jit_backend());
+    assert(code.size());
+    speculation_after_load = {move(code), default_mode};
+}
+
+void cancel_speculation() {
+    if(background_source.size())
+        cancel_background_build();
+}
+
+void start_warmup(bool link_plugin) {
+    assert(!is_compiling());
+
+#ifdef RCRL_JIT
+    // creating the interpreter and parsing the prelude is what the first submission would pay for
+    (void)link_plugin;
+    cancel_background_build();
+    jit::warmup();
+#else  // RCRL_JIT
+    // only what every plugin starts with - the plugin built from this is never loaded
+    string source = compiled_sections.size() ? make_plugin_source({}) : "#include \"rcrl/rcrl_for_plugin.h\"\n";
+    start_background_build(source, link_plugin ? RCRL_PLUGIN_NAME : RCRL_PLUGIN_WARMUP_TARGET, false);
+#endif // RCRL_JIT
+}
+
+bool is_warming_up() {
+#ifdef RCRL_JIT
+    return jit::is_warming_up();
+#else  // RCRL_JIT
+    int exitcode;
+    return background_process && background_source.empty() && !background_process->try_get_exit_status(exitcode);
+#endif // RCRL_JIT
+}
+
+string get_new_compiler_output(size_t max_size) {
+    lock_guard<mutex> lock(compiler_output_mut);
+    // already translated by the process which was rolled back
+    string out = move(rolled_back_output);
+    rolled_back_output.clear();
+    // a piece might be left out entirely (the lines of a time report) - that isn't the end of the output
+    while(out.empty()) {
+        // only complete lines can be translated - the rest waits for the next call unless the compilation is over
+        auto end = is_compiling() ? compiler_output.rfind('\n') + 1 : compiler_output.size();
+        // within the budget - but at least a whole line
+        if(end > max_size) {
+            auto last = compiler_output.rfind('\n', max_size - 1);
+            if(last == string::npos)
+                last = compiler_output.find('\n');
+            if(last != string::npos)
+                end = min(end, last + 1);
+        }
+        if(end == 0)
+            break;
+#ifdef RCRL_TIME_REPORT
+        out = translate_diagnostics(time_report::remove_report(compiler_output.substr(0, end)));
+#else  // RCRL_TIME_REPORT
+        out = translate_diagnostics(compiler_output.substr(0, end));
+#endif // RCRL_TIME_REPORT
+        compiler_output.erase(0, end);
+    }
+    return out;
 }
 
-bool is_compiling() { return compiler_process != nullptr; }
+bool is_compiling() {
+#ifdef RCRL_JIT
+    return jit::is_compiling();
+#else  // RCRL_JIT
+    return compiler_process != nullptr;
+#endif // RCRL_JIT
+}
 
 bool try_get_exit_status_from_compile(int& exitcode) {
+#ifdef RCRL_JIT
+    if(jit::try_get_exit_status(exitcode)) {
+#else  // RCRL_JIT
     if(compiler_process && compiler_process->try_get_exit_status(exitcode)) {
         // remove the compiler process
         compiler_process.reset();
+#endif // RCRL_JIT
 
         last_compile_successful = exitcode == 0;
+        last_compile_time       = chrono::duration<double>(chrono::steady_clock::now() - compile_start).count();
+#ifdef RCRL_TIME_REPORT
+        last_time_report = build_time_report();
+#endif // RCRL_TIME_REPORT
 
         return true;
     }
     return false;
 }
 
+void cancel_compile() {
+    assert(is_compiling());
+
+#ifdef RCRL_JIT
+    jit::cancel();
+#else  // RCRL_JIT
+    int exitcode;
+    if(!compiler_process->try_get_exit_status(exitcode)) {
+        compiler_process->kill(true);
+        compiler_process->get_exit_status();
+    }
+    compiler_process.reset();
+
+    lock_guard<mutex> lock(compiler_output_mut);
+    background_adopted = false;
+#endif // RCRL_JIT
+
+    uncompiled_sections.clear();
+    last_compile_successful = false;
+}
+
+double get_last_compile_time() { return last_compile_time; }
+
+CompileTimeReport get_last_compile_time_report() { return last_time_report; }
+
+void set_unload_once_only_plugins(bool enabled) {
+    assert(!enabled || !is_jit_backend());
+    unload_once_only_plugins = enabled;
+}
+
+void set_plugin_barrier(void (*barrier)()) { plugin_barrier = barrier; }
+
+void set_output_notifier(void (*notifier)()) { output_notifier = notifier; }
+
+void set_profiling(bool enabled, int frequency, double max_seconds) {
+    assert(frequency > 0);
+    assert(max_seconds > 0);
+    profiling_frequency = enabled ? frequency : 0;
+    max_profile_seconds = max_seconds;
+    if(!enabled)
+        profiler::release();
+}
+
+Profile get_last_profile() { return last_profile; }
+
+vector<PluginInfo> get_plugin_infos() {
+    vector<PluginInfo> out;
+    for(const auto& plugin : plugins)
+        out.push_back(plugin.info);
+    return out;
+}
+
+string get_last_load_error() { return load_error; }
+
+vector<VarInfo> get_var_infos() {
+    vector<VarInfo> out;
+    for(const auto& var : persistence)
+        out.push_back({var.first, var.second.type, var.second.size, var.second.heap_size, var.second.plugin});
+    return out;
+}
+
 string copy_and_load_new_plugin(bool redirect_stdout) {
     assert(!is_compiling());
     assert(last_compile_successful);
 
     last_compile_successful = false; // shouldn't call this function twice in a row without compiling anything in between
 
+    auto first_section = compiled_sections.size();
     for(const auto& section : uncompiled_sections)
-        if(section.second != ONCE)
+        if(section.second == GLOBAL || section.second == VARS)
             compiled_sections.push_back(section.first);
 
-    // copy the plugin
-    auto       name_copied = string(RCRL_BIN_FOLDER) + RCRL_PLUGIN_NAME "_" + to_string(plugins.size()) + RCRL_EXTENSION;
+#ifndef RCRL_JIT
+    // copy the plugin - named after the submission so the copy of an undone plugin (which might still be mapped if something
+    // kept it loaded) is never overwritten
+    auto       name_copied = string(RCRL_BIN_FOLDER) + RCRL_PLUGIN_NAME "_" + to_string(submission_count) + RCRL_EXTENSION;
     const auto copy_res =
             RCRL_CopyDynlib((string(RCRL_BIN_FOLDER) + RCRL_PLUGIN_NAME RCRL_EXTENSION).c_str(), name_copied.c_str());
     assert(copy_res);
+#endif // RCRL_JIT
+    ++submission_count;
+
+    // the build of the next code can overlap with loading this plugin now that it has been copied
+    if(speculation_after_load.first.size()) {
+        speculate_code(move(speculation_after_load.first), speculation_after_load.second);
+        speculation_after_load.first.clear();
+    }
 
     if(redirect_stdout)
         freopen(RCRL_BUILD_FOLDER "/rcrl_stdout.txt", "w", stdout);
 
+    PluginInfo info;
+    auto       load_start     = chrono::steady_clock::now();
+    auto       num_deleters   = deleters.size();
+    auto       num_persistent = persistence.size();
+
+    if(profiling_frequency)
+        profiler::start(profiling_frequency, max_profile_seconds);
+
+    auto heap_before = get_heap_in_use();
+    loading_plugin   = int(plugins.size());
+    load_error.clear();
+
+#ifdef RCRL_JIT
+    // run the static initializers of the new translation unit - there is nothing to copy or load
+    jit::execute();
+    RCRL_Dynlib plugin = nullptr;
+    info.name          = "jit_" + to_string(submission_count);
+#else  // RCRL_JIT
     // load the plugin
-    auto plugin = RDRL_LoadDynlib(name_copied.c_str());
+    auto threads_before = get_thread_count();
+    auto plugin         = RDRL_LoadDynlib(name_copied.c_str());
     assert(plugin);
+    info.name = name_copied;
+#endif // RCRL_JIT
+
+    if(plugin_barrier)
+        plugin_barrier();
+
+    info.load_time = chrono::duration<double>(chrono::steady_clock::now() - load_start).count();
+
+    auto heap_after  = get_heap_in_use();
+    info.heap_growth = heap_after > heap_before ? heap_after - heap_before : 0;
+    loading_plugin   = -1;
+    for(const auto& var : persistence) {
+        if(var.second.plugin == int(plugins.size())) {
+            ++info.num_vars;
+            info.vars_size += var.second.size;
+            info.vars_heap_size += var.second.heap_size;
+        }
+    }
+
+    // the plugin can't be unloaded before its addresses are symbolized
+    if(profiling_frequency) {
+        last_profile = profiler::stop();
+        ofstream(RCRL_BUILD_FOLDER "/rcrl_profile.folded") << last_profile.collapsed;
+    }
+
+#ifndef RCRL_JIT
+    info.file_size = get_file_size(name_copied);
+    auto segments  = get_mapped_segments(name_copied);
+    for(const auto& segment : segments)
+        info.mapped_size += segment.second - segment.first;
+
+    // a plugin with only once (or bench) sections which hasn't created any persistent state and nothing from which
+    // escaped into the existing persistent variables isn't needed after its once sections have been executed - unless
+    // they have started threads or registered a migration hook (which would be called after the plugin is gone)
+    bool only_once_sections =
+            all_of(uncompiled_sections.begin(), uncompiled_sections.end(),
+                   [](const pair<string, Mode>& section) { return section.second == ONCE || section.second == BENCH; });
+    bool registered_migration =
+            any_of(migration_plugins.begin(), migration_plugins.end(),
+                   [&](const pair<const string, int>& hook) { return hook.second == int(plugins.size()); });
+    if(unload_once_only_plugins && only_once_sections && deleters.size() == num_deleters &&
+       persistence.size() == num_persistent && !registered_migration && get_thread_count() <= threads_before &&
+       segments.size() && !persistence_points_into(segments)) {
+        auto memory_before = get_resident_memory();
+        RCRL_CloseDynlib(plugin);
+        plugin = nullptr;
+        remove(name_copied.c_str());
+
+        auto memory_after = get_resident_memory();
+        info.unloaded     = true;
+        info.reclaimed    = memory_before > memory_after ? memory_before - memory_after : 0;
+    }
+#endif // RCRL_JIT
 
     // add the plugin to the list of loaded ones - for later unloading
-    plugins.push_back({name_copied, plugin});
+    plugins.push_back({info, plugin, num_deleters, first_section});
+
+    // the error goes to the output of the plugin
+    if(load_error.size()) {
+        fputs(load_error.c_str(), stdout);
+#ifdef RCRL_JIT
+        puts("RCRL: the JIT backend can't take back the code - the redeclared variables refer to objects of their own");
+#else  // RCRL_JIT
+        puts("RCRL: the plugin has been unloaded - the old objects are kept");
+        unload_last_plugins(1);
+#endif // RCRL_JIT
+    }
 
     string out;
 
-    if(redirect_stdout) {
-        fclose(stdout);
-        freopen("CON", "w", stdout);
+    if(redirect_stdout)
+        out = restore_stdout();
 
-        FILE* f = fopen(RCRL_BUILD_FOLDER "/rcrl_stdout.txt", "rb");
-        fseek(f, 0, SEEK_END);
-        long fsize = ftell(f);
-        fseek(f, 0, SEEK_SET);
+    return out;
+}
 
-        out.resize(fsize);
-        fread((void*)out.data(), fsize, 1, f);
-        fclose(f);
+#ifndef _WIN32
+// reads or writes everything (unless the other end is closed)
+static bool read_all(int fd, void* data, size_t size) {
+    for(auto bytes = static_cast<char*>(data); size;) {
+        auto n = read(fd, bytes, size);
+        if(n <= 0 && !(n < 0 && errno == EINTR))
+            return false;
+        bytes += max<ssize_t>(n, 0);
+        size -= max<ssize_t>(n, 0);
     }
+    return true;
+}
+static void write_all(int fd, const void* data, size_t size) {
+    for(auto bytes = static_cast<const char*>(data); size;) {
+        auto n = write(fd, bytes, size);
+        if(n <= 0 && !(n < 0 && errno == EINTR))
+            return;
+        bytes += max<ssize_t>(n, 0);
+        size -= max<ssize_t>(n, 0);
+    }
+}
+#endif // _WIN32
 
-    return out;
+int checkpoint() {
+    assert(!is_compiling());
+
+#ifdef _WIN32
+    return -1;
+#else  // _WIN32
+    // nothing from another thread may be half done in the copy - and buffered output shouldn't be written twice
+    cancel_background_build();
+    if(plugin_barrier)
+        plugin_barrier();
+    fflush(stdout);
+    fflush(stderr);
+
+    // the original process stays here - each rollback to it continues in a new copy so it can be rolled back to again
+    int value = 0;
+    for(;;) {
+        int fds[2];
+        if(pipe(fds) != 0)
+            return -1;
+        // the compilers started by the copy shouldn't keep the pipe open
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+        auto pid = fork();
+        if(pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            return -1;
+        }
+        if(pid == 0) {
+            close(fds[0]);
+            checkpoints.push_back(fds[1]);
+            return value;
+        }
+        close(fds[1]);
+
+        // a rollback sends the value and the compiler output - the pipe is closed without that if the copy exits
+        uint64_t output_size = 0;
+        string   output;
+        bool     rolled_back = read_all(fds[0], &value, sizeof(value));
+        rolled_back          = rolled_back && read_all(fds[0], &output_size, sizeof(output_size));
+        output.resize(rolled_back ? size_t(output_size) : 0);
+        rolled_back = rolled_back && read_all(fds[0], &output[0], output.size());
+        close(fds[0]);
+
+        int status = 0;
+        while(waitpid(pid, &status, 0) < 0 && errno == EINTR)
+            ;
+        // the copy has exited normally - so does the whole chain of frozen processes (without their destructors)
+        if(!rolled_back)
+            _exit(WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+
+        rolled_back_output += output;
+    }
+#endif // _WIN32
 }
+
+void rollback(int value) {
+    assert(checkpoints.size());
+
+#ifndef _WIN32
+    if(is_compiling())
+        cancel_compile();
+    cancel_background_build();
+    fflush(stdout);
+    fflush(stderr);
+
+    // the output which the host hasn't taken yet goes on in the checkpoint
+    auto     output      = get_new_compiler_output();
+    uint64_t output_size = output.size();
+    write_all(checkpoints.back(), &value, sizeof(value));
+    write_all(checkpoints.back(), &output_size, sizeof(output_size));
+    write_all(checkpoints.back(), output.data(), output.size());
+    // nothing of this process is cleaned up - the plugins and the persistent variables are those of the checkpoint
+    _exit(0);
+#endif // _WIN32
+}
+
+size_t get_checkpoint_count() { return checkpoints.size(); }
 } // namespace rcrl
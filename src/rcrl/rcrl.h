@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 // RCRL assumes that the following preprocessor identifiers are defined (easy with CMake):
 // - RCRL_PLUGIN_FILE - the full path to the .cpp file used for compilation
@@ -9,6 +10,10 @@
 // - RCRL_BIN_FOLDER - the folder with compiled binaries - the plugin will be copied/loaded from there
 // - RCRL_EXTENSION - the shared object extension - '.dll' for Windows, '.so' for Linux and '.dylib' for macOS
 // - RCRL_CONFIG - optional - if the current build system supports multiple configurations at once (Visual Studio, XCode)
+// - RCRL_PLUGIN_WARMUP_TARGET - optional - a target which builds the precompiled header of the plugin without linking it
+// - RCRL_TIME_REPORT - optional - the plugin is built with -ftime-report -H (GCC) or -ftime-trace (Clang) - see
+//   rcrl::get_last_compile_time_report()
+// - RCRL_TIME_TRACE_FILE - optional - where Clang writes the trace (given to it with -ftime-trace=<file>)
 
 namespace rcrl
 {
@@ -16,9 +21,116 @@ enum Mode
 {
     GLOBAL,
     VARS,
-    ONCE
+    ONCE,
+    BENCH
 };
 
+// Information about a plugin loaded by rcrl::copy_and_load_new_plugin()
+struct PluginInfo
+{
+    std::string name;                   // the path of the loaded copy of the plugin
+    double      load_time      = 0;     // seconds spent loading it - with running its once sections and vars initializers
+    size_t      file_size      = 0;     // bytes copied to disk for it
+    size_t      mapped_size    = 0;     // bytes of address space for its loadable segments (0 where not supported)
+    bool        unloaded       = false; // if it was unloaded right after loading - see set_unload_once_only_plugins()
+    size_t      reclaimed      = 0;     // the drop of resident memory when it was unloaded (Linux only)
+    size_t      heap_growth    = 0;     // bytes of heap in use after loading it minus before that (glibc only)
+    size_t      num_vars       = 0;     // persistent variables created by it - see rcrl::get_var_infos()
+    size_t      vars_size      = 0;     // the sizeof of these variables
+    size_t      vars_heap_size = 0;     // the heap_size of these variables
+};
+
+// Information about a persistent variable from a vars section
+struct VarInfo
+{
+    std::string name;
+    std::string type;          // the mangled name of the type (from typeid)
+    size_t      size      = 0; // sizeof the object
+    size_t      heap_size = 0; // bytes of heap still in use out of what its construction allocated - with the object
+                               // itself (glibc only) - growth after that (push_back later on) isn't accounted for
+    int         plugin    = 0; // the index of the plugin which created it in rcrl::get_plugin_infos()
+};
+
+// A piece of code for rcrl::submit_batch()
+struct Snippet
+{
+    std::string code;
+    Mode        default_mode = ONCE;
+    std::string name; // diagnostics refer to it as a file name (shouldn't contain quotes) - "snippet_<n>" if empty
+};
+
+// The diagnostics attributed to a snippet from the last rcrl::submit_batch()
+struct SnippetResult
+{
+    std::string name;
+    bool        has_errors = false; // an error (not a warning or a note) is reported for its lines
+    std::string diagnostics;
+};
+
+// Settings for running the code from bench sections - each is run in a loop with as many iterations as needed for a
+// repetition to take at least min_time and the results (per iteration) are printed to stdout when the plugin is loaded
+struct BenchOptions
+{
+    double warmup_time       = 0.05; // seconds of running it before measuring
+    double min_time          = 0.02; // seconds per repetition
+    int    repetitions       = 10;   // for the mean, median and standard deviation
+    bool   hardware_counters = true; // cycles, instructions, cache and branch misses - Linux only (perf_event_open)
+};
+
+// A function in a profile from the sampling profiler - see rcrl::set_profiling()
+struct ProfileEntry
+{
+    std::string name;
+    size_t      self  = 0; // samples in which it is the innermost frame
+    size_t      total = 0; // samples in which it is anywhere in the call stack
+};
+
+// A node of the call graph in a profile - the children are the functions called from it
+struct ProfileNode
+{
+    std::string              name;
+    size_t                   samples = 0;
+    std::vector<ProfileNode> children;
+};
+
+// The profile of loading a plugin - when its once, vars and bench sections are executed
+struct Profile
+{
+    size_t                    samples  = 0;
+    size_t                    dropped  = 0; // samples which didn't fit in the buffer - see rcrl::set_profiling()
+    double                    interval = 0; // seconds of CPU time between samples
+    std::vector<ProfileEntry> flat;         // sorted by self samples
+    ProfileNode               call_graph;   // from the outermost frames - the root has no name
+    std::string               collapsed;    // "outer;inner count" lines - for flame graph tools
+};
+
+// An entry in a compile time report - the time is in seconds (0 if the compiler doesn't report it for such entries)
+struct CompileTimeEntry
+{
+    std::string name;
+    double      time  = 0;
+    size_t      count = 0; // times a template is instantiated, headers included through a header (with itself)...
+};
+
+// What the last compilation spent its time on - each list is sorted by time (or count if there are no times):
+// - GCC reports only the time of its phases (template instantiation is one of them) - the headers are weighed by how
+//   many headers they include and there are no templates or functions
+// - Clang reports the time of each header, template instantiation and function
+struct CompileTimeReport
+{
+    double                        frontend = 0; // seconds - preprocessing, parsing, templates
+    double                        backend  = 0; // seconds - optimization and code generation
+    std::vector<CompileTimeEntry> phases;
+    std::vector<CompileTimeEntry> headers;
+    std::vector<CompileTimeEntry> templates;
+    std::vector<CompileTimeEntry> functions;
+    std::vector<CompileTimeEntry> pch_suggestions; // includes from global sections to move to precompiled_for_plugin.h
+};
+
+// Returns true if the code is compiled by the in-process JIT backend instead of the build system (RCRL_JIT) - it doesn't
+// support rcrl::undo(), speculative builds and unloading plugins made only of once sections
+bool is_jit_backend();
+
 // Cleanup:
 // - calls the destructors of persistent variables
 // - unloads the plugins and deletes them from the filesystem
@@ -27,6 +139,20 @@ enum Mode
 // - compilation is in progress
 std::string cleanup_plugins(bool redirect_stdout = false);
 
+// Undoes the last n loaded plugins - for a mistaken submission without a full cleanup and replay:
+// - calls only the deleters of the persistent variables created while loading them (in reverse order)
+// - forgets their persistent variables and their global and vars sections so the next submissions are compiled without
+//   them - a variable which one of them has migrated to a new type is forgotten as well (its old object is gone)
+// - unloads them in reverse order and deletes them from the filesystem
+// - what their once sections have changed outside of their own variables stays changed
+// - a successful compilation which hasn't been loaded yet is discarded (it has been built on top of them)
+// - can optionally redirect stdout while unloading them - like rcrl::cleanup_plugins()
+// Shouldn't be called if:
+// - compilation is in progress
+// - n is more than the number of loaded plugins (see rcrl::get_plugin_infos())
+// - the JIT backend is used - its code can't be taken out of the interpreter piece by piece (see rcrl::is_jit_backend())
+std::string undo(size_t n = 1, bool redirect_stdout = false);
+
 // Submits code for compilation:
 // - parses the code for the 3 different sections in single line comments: // global/vars/once
 //   with the default mode for the begining so such an annotation can be skipped for the first section
@@ -41,8 +167,61 @@ std::string cleanup_plugins(bool redirect_stdout = false);
 // - code is empty
 bool submit_code(std::string code, Mode default_mode = ONCE, bool* used_default_mode = nullptr);
 
-// Returns any new compiler output, since it's done in a background thread (also returns parser errors)
-std::string get_new_compiler_output();
+// Submits multiple snippets of code for compilation as a single plugin - instead of a round-trip for each:
+// - the sections of all snippets go in the order of the snippets so once sections and vars initializers are still
+//   executed in that order - when the plugin is loaded
+// - the sections get #line directives with the names of the snippets so diagnostics refer to the snippets
+// - the result of the compilation and the loading are the same as for rcrl::submit_code()
+// - returns false if any of the snippets doesn't parse - parse errors are reported for all of them
+// Shouldn't be called if:
+// - compilation is in progress
+// - there are no snippets
+bool submit_batch(const std::vector<Snippet>& snippets);
+
+// Returns the diagnostics attributed to each snippet from the last rcrl::submit_batch() - after the compilation has ended
+// (or submit_batch() has returned false) - nothing is loaded unless none of the snippets has errors
+std::vector<SnippetResult> get_batch_results();
+
+// Starts a background build of only what every plugin starts with so the precompiled header (or header units) and the
+// state of the build system are ready and the first submission costs the same as the ones after it:
+// - can optionally link the (empty) plugin as well - otherwise only the precompiled header is built
+// - the output is discarded and is_compiling() is not affected by it
+// - submit_code() and cleanup_plugins() cancel it if it hasn't finished yet
+// Shouldn't be called if:
+// - compilation is in progress
+void start_warmup(bool link_plugin = true);
+
+// Returns true while the warm-up started with rcrl::start_warmup() is still running
+bool is_warming_up();
+
+// Starts compiling code in the background without loading it - meant to be called while the user is typing:
+// - if the same code is later passed to submit_code() this build is adopted (even if still running) instead of starting over
+// - a previous speculative build for different code (or a warm-up) is cancelled
+// - returns false if the code doesn't parse - nothing is started and no parser errors are reported
+// Shouldn't be called if:
+// - compilation is in progress
+// - code is empty
+// - the JIT backend is used - compiling would change the state of the interpreter (see rcrl::is_jit_backend())
+bool speculate_code(std::string code, Mode default_mode = ONCE);
+
+// Same as rcrl::speculate_code() but the build is started by the next rcrl::copy_and_load_new_plugin() right after the
+// plugin has been copied - so it overlaps with loading it and running its once sections:
+// - the code should be what is submitted after that plugin (it is built on top of it) - for when that is known in advance
+// Shouldn't be called if:
+// - code is empty
+// - the JIT backend is used
+void speculate_code_after_load(std::string code, Mode default_mode = ONCE);
+
+// Cancels and discards the running speculative build (if any) - for when the code it was started for changes
+void cancel_speculation();
+
+// Returns any new compiler output, since it's done in a background thread (also returns parser errors):
+// - the generated code has #line directives so locations refer to the submitted code - they are rewritten to include the
+//   submission and the section as well: "submission 3, once section 2, line 5:7: error: ..."
+// - only complete lines are returned while compiling
+// - at most max_size bytes of lines (but at least a whole line) - the rest is left for the next calls so a huge log can
+//   be taken a bit at a time (the cost of translating the diagnostics is proportional to the size)
+std::string get_new_compiler_output(size_t max_size = std::string::npos);
 
 // Returns true if compilation is in progress
 bool is_compiling();
@@ -56,11 +235,115 @@ bool is_compiling();
 // being started - it will return false - so make sure to use the result exit code from when it returns true
 bool try_get_exit_status_from_compile(int& exitcode);
 
+// Stops the running compilation and discards the code submitted for it - for when it has been superseded by newer code:
+// - the compiler output from it is kept
+// - the JIT backend can't interrupt clang so it waits for it and then discards the result
+// Shouldn't be called if:
+// - compilation is not in progress
+void cancel_compile();
+
+// Returns the wall time in seconds of the last finished compilation - for comparing build setups (precompiled header,
+// header units, JIT) - 0 if nothing has been compiled yet
+double get_last_compile_time();
+
+// Returns what the last compilation spent its time on (its top headers, templates and functions):
+// - the report is empty unless RCRL_TIME_REPORT is defined (CMake option RCRL_PLUGIN_TIME_REPORT)
+// - the output of -ftime-report and -H is left out of rcrl::get_new_compiler_output()
+CompileTimeReport get_last_compile_time_report();
+
 // Copies the plugin from the last successful compilation with a new name and loads it:
 // - can optionally redirect stdout only while loading the plugin (uses a temp .txt file) - and returns it
+// - a plugin which redeclares a persistent variable with a different type (without a migration hook registered for it
+//   by an earlier plugin) is rejected - it is unloaded right after loading it like with rcrl::undo(1) and the old object
+//   is kept - its once and bench sections after the redeclaration aren't executed (the ones before it in the same
+//   submission have already been) - the error is printed to stdout and by rcrl::get_last_load_error()
+// - the type is identified by its name, size, alignment and a few traits (see rcrl_type_layout()) - reordered members
+//   or a member changed to another type of the same size and alignment aren't detected
 // Shouldn't be called if:
 // - compilation is in progress
 // - the last compilation was unsuccessful (use the exit code from rcrl::try_get_exit_status_from_compile() to determine that)
 // - the plugin from the last compilation has already been loaded
 std::string copy_and_load_new_plugin(bool redirect_stdout = false);
+
+// Returns why the plugin from the last rcrl::copy_and_load_new_plugin() has been rejected - empty if it has been loaded
+std::string get_last_load_error();
+
+// When enabled plugins made only of once sections are unloaded (and deleted) right after their code has been executed:
+// - only if they haven't created any persistent variables, registered a migration hook (rcrl_add_migration()) or
+//   started threads which are still running
+// - and if none of the existing persistent variables holds a pointer into the plugin (a lambda or a function escaping
+//   into persistence) - the heap memory reachable from them is scanned too (a lambda pushed into a persistent vector)
+//   but the scan is still shallow: a pointer handed to the state of the host (a callback registered with it) or
+//   stored anywhere else isn't found and the plugin is unloaded from under it
+// - the scan reads the headers of the heap blocks of glibc so it is done only with its allocator on 64-bit (not with
+//   a replacement like jemalloc or under AddressSanitizer) - otherwise plugins are never unloaded - and it gives up
+//   (keeping the plugin) after 65536 heap blocks
+// Disabled by default - shouldn't be enabled if the JIT backend is used (there is nothing to unload)
+void set_unload_once_only_plugins(bool enabled);
+
+// Sets a function which is called after the code of each plugin has been executed and before plugins are unloaded (by
+// rcrl::cleanup_plugins() or right after loading - see rcrl::set_unload_once_only_plugins()):
+// - for a host which runs code from the plugins asynchronously (on a job system for example) - it should wait for that
+//   to finish so the result of a submission is deterministic and nothing runs the code of a plugin after it is unloaded
+// - its time is a part of the load time of the plugin
+// None by default
+void set_plugin_barrier(void (*barrier)());
+
+// Sets a function which is called from other threads when there is new compiler output and when a build (or the JIT
+// compilation) has finished - so a host which sleeps while idle (in glfwWaitEvents() for example) can be woken up
+// (with glfwPostEmptyEvent()) instead of polling rcrl::get_new_compiler_output() and the exit status every frame
+// None by default
+void set_output_notifier(void (*notifier)());
+
+// Sets the settings for running bench sections - used by the plugins loaded after that
+void set_bench_options(const BenchOptions& options);
+
+// When enabled the loading of plugins (executing their code) is profiled with a sampling profiler:
+// - the frequency is in samples per second of CPU time of the loading thread
+// - the profile of the last loaded plugin is returned by rcrl::get_last_profile() and its call stacks are also written to
+//   RCRL_BUILD_FOLDER/rcrl_profile.folded in the collapsed format for flame graph tools
+// - the samples go in a buffer which is allocated before loading - it starts with a tenth of a second of CPU time and
+//   is doubled for the next plugin whenever one doesn't fit in it (the samples after that are dropped) - up to
+//   max_seconds of CPU time - and it is freed when profiling is disabled
+// - Linux only - elsewhere the profiles are empty
+// Disabled by default
+void set_profiling(bool enabled, int frequency = 1000, double max_seconds = 60);
+
+// Returns the profile of the last plugin loaded while profiling was enabled
+Profile get_last_profile();
+
+// Returns information about the plugins loaded since the last cleanup - in the order in which they were loaded
+std::vector<PluginInfo> get_plugin_infos();
+
+// Returns information about the persistent variables created since the last cleanup - sorted by name:
+// - a variable redeclared by a later plugin is still attributed to the plugin which created it - unless it is migrated
+//   to a different type (the new object is created by the later plugin)
+// - the heap is measured for the whole process so allocations from other threads during a construction (or loading a
+//   plugin) are attributed to it as well
+std::vector<VarInfo> get_var_infos();
+
+// Checkpoints of the whole session for headless hosts - through fork() so the state is shared copy-on-write:
+// - rcrl::checkpoint() returns 0 in a copy of the process which goes on while the original one is frozen with the
+//   plugins, persistent variables and everything else in the process as they were
+// - rcrl::rollback(value) ends the current process and a new copy of the last checkpoint returns the value (which should
+//   be positive) from rcrl::checkpoint() - so the same checkpoint can be rolled back to any number of times
+// - when a process exits without a rollback the frozen ones exit with the same status (without any cleanup)
+// - only the calling thread exists in the copy - a host with threads of its own should stop them before the call and
+//   start them after it - builds in the background are cancelled and the plugin barrier is called before forking
+// - stdout and stderr are flushed before forking and before a rollback - and the compiler output which hasn't been taken
+//   with rcrl::get_new_compiler_output() before a rollback is returned by it in the checkpoint
+// - returns -1 if the checkpoint couldn't be made (always on Windows)
+// Shouldn't be called if:
+// - compilation is in progress
+int checkpoint();
+
+// Ends the current process and continues from the last checkpoint - see rcrl::checkpoint() - a compilation in progress
+// is cancelled
+// Shouldn't be called if:
+// - there are no checkpoints
+void rollback(int value);
+
+// Returns the number of checkpoints made by the current process and the ones it was copied from - a rollback goes to the
+// last of them
+size_t get_checkpoint_count();
 } // namespace rcrl
\ No newline at end of file
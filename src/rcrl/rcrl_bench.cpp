@@ -0,0 +1,154 @@
+#include "rcrl.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif // __linux__
+
+#ifdef _WIN32
+#define RCRL_SYMBOL_EXPORT __declspec(dllexport)
+#else
+#define RCRL_SYMBOL_EXPORT __attribute__((visibility("default")))
+#endif
+
+using namespace std;
+
+namespace rcrl
+{
+static BenchOptions bench_options;
+
+void set_bench_options(const BenchOptions& options) { bench_options = options; }
+
+// hardware counters for the current thread through perf_event_open() - those which can't be opened are skipped
+class HardwareCounters
+{
+public:
+    HardwareCounters() {
+#ifdef __linux__
+        const pair<uint64_t, const char*> events[] = {{PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+                                                      {PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+                                                      {PERF_COUNT_HW_CACHE_MISSES, "cache misses"},
+                                                      {PERF_COUNT_HW_BRANCH_MISSES, "branch misses"}};
+        for(const auto& event : events) {
+            perf_event_attr attr = {};
+            attr.type            = PERF_TYPE_HARDWARE;
+            attr.size            = sizeof(attr);
+            attr.config          = event.first;
+            attr.disabled        = 1;
+            attr.exclude_kernel  = 1;
+            attr.exclude_hv      = 1;
+            int fd               = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if(fd != -1)
+                counters.push_back({fd, event.second});
+        }
+#endif // __linux__
+    }
+    ~HardwareCounters() {
+#ifdef __linux__
+        for(const auto& counter : counters)
+            close(counter.first);
+#endif // __linux__
+    }
+
+    void start() {
+#ifdef __linux__
+        for(const auto& counter : counters) {
+            ioctl(counter.first, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter.first, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif // __linux__
+    }
+
+    // returns the names of the counters with their values since start()
+    vector<pair<const char*, uint64_t>> stop() {
+        vector<pair<const char*, uint64_t>> out;
+#ifdef __linux__
+        for(const auto& counter : counters) {
+            ioctl(counter.first, PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t value = 0;
+            if(read(counter.first, &value, sizeof(value)) == sizeof(value))
+                out.push_back({counter.second, value});
+        }
+#endif // __linux__
+        return out;
+    }
+
+private:
+    vector<pair<int, const char*>> counters;
+};
+} // namespace rcrl
+
+using namespace rcrl;
+
+// for use by the rcrl plugin - the body runs the code from a bench section the given number of times - the timings of
+// a body compiled without optimizations are marked as such (they say little about the optimized code)
+RCRL_SYMBOL_EXPORT int rcrl_run_benchmark(const char* label, void (*body)(size_t iterations), bool optimized) {
+    using clock = chrono::steady_clock;
+    auto time   = [&](size_t iterations) {
+        auto start = clock::now();
+        body(iterations);
+        return chrono::duration<double>(clock::now() - start).count();
+    };
+
+    // warm-up - caches, branch predictors, lazy binding and page faults
+    auto warmup_end = clock::now() + chrono::duration<double>(bench_options.warmup_time);
+    do
+        body(1);
+    while(clock::now() < warmup_end);
+
+    // calibration - enough iterations for a repetition to take at least the minimal time so the clock resolution and
+    // the overhead of the call don't matter
+    size_t iterations = 1;
+    double elapsed    = time(iterations);
+    while(elapsed < bench_options.min_time && iterations < (size_t(1) << 40)) {
+        // aim a bit higher than needed based on the last measurement - at most 10 times more iterations at once
+        auto factor = elapsed > 0 ? min(10.0, 1.2 * bench_options.min_time / elapsed) : 10.0;
+        iterations  = max(iterations + 1, size_t(iterations * factor));
+        elapsed     = time(iterations);
+    }
+
+    // the measurements
+    HardwareCounters counters;
+    if(bench_options.hardware_counters)
+        counters.start();
+    vector<double> ns_per_iteration;
+    for(int i = 0; i < max(1, bench_options.repetitions); ++i)
+        ns_per_iteration.push_back(time(iterations) * 1e9 / iterations);
+    auto hardware = bench_options.hardware_counters ? counters.stop() : vector<pair<const char*, uint64_t>>();
+
+    // the statistics
+    double mean = 0;
+    for(auto ns : ns_per_iteration)
+        mean += ns;
+    mean /= ns_per_iteration.size();
+    double variance = 0;
+    for(auto ns : ns_per_iteration)
+        variance += (ns - mean) * (ns - mean);
+    auto stddev = ns_per_iteration.size() > 1 ? sqrt(variance / (ns_per_iteration.size() - 1)) : 0;
+    sort(ns_per_iteration.begin(), ns_per_iteration.end());
+    auto middle = ns_per_iteration.size() / 2;
+    auto median = ns_per_iteration.size() % 2 ? ns_per_iteration[middle] :
+                                                (ns_per_iteration[middle - 1] + ns_per_iteration[middle]) / 2;
+
+    printf("bench %s%s: %d x %llu iterations - mean %.3f ns, median %.3f ns, stddev %.3f ns (%.1f%%)\n", label,
+           optimized ? "" : " (unoptimized)", int(ns_per_iteration.size()), (unsigned long long)iterations, mean, median,
+           stddev, mean > 0 ? 100 * stddev / mean : 0.0);
+    if(hardware.size()) {
+        auto total = double(iterations) * ns_per_iteration.size();
+        printf("bench %s: per iteration -", label);
+        for(const auto& counter : hardware)
+            printf(" %.2f %s", counter.second / total, counter.first);
+        printf("\n");
+    }
+    fflush(stdout);
+    return 0;
+}
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <typeinfo>
+
 #define RCRL_EMPTY()
 
 #define RCRL_CAT_IMPL(s1, s2) s1##s2
@@ -17,17 +22,74 @@
 #define RCRL_SYMBOL_IMPORT
 #endif
 
-// for statements inside of a once section
-#define RCRL_ONCE_BEGIN static int RCRL_ANONYMOUS(rcrl_anon_) = []() {
+// for statements inside of a once section - skipped once the host has rejected the plugin being loaded
+#define RCRL_ONCE_BEGIN static int RCRL_ANONYMOUS(rcrl_anon_) = rcrl_is_load_rejected() ? 0 : []() {
 #define RCRL_ONCE_END return 0; }();
 
+// bench sections are compiled with optimizations even if the plugin isn't (only GCC can do that for a part of a file) -
+// elsewhere they are as optimized as the plugin and the timings are marked as unoptimized if it isn't (MSVC doesn't tell
+// so a build with _DEBUG is taken as one without optimizations)
+#if defined(__GNUC__) && !defined(__clang__)
+#define RCRL_BENCH_OPTIMIZE_BEGIN _Pragma("GCC push_options") _Pragma("GCC optimize(\"O2\")")
+#define RCRL_BENCH_OPTIMIZE_END _Pragma("GCC pop_options")
+#define RCRL_BENCH_OPTIMIZED true
+#else
+#define RCRL_BENCH_OPTIMIZE_BEGIN
+#define RCRL_BENCH_OPTIMIZE_END
+#if defined(__OPTIMIZE__) || (defined(_MSC_VER) && !defined(_DEBUG))
+#define RCRL_BENCH_OPTIMIZED true
+#else
+#define RCRL_BENCH_OPTIMIZED false
+#endif
+#endif
+
+// for statements inside of a bench section - the host runs them in a loop with as many iterations as it needs
+#define RCRL_BENCH_BEGIN(label)                                                                                             \
+    RCRL_BENCH_OPTIMIZE_BEGIN                                                                                               \
+    static int RCRL_ANONYMOUS(rcrl_anon_) =                                                                                 \
+            rcrl_is_load_rejected() ? 0 : rcrl_run_benchmark(label, [](size_t rcrl_iterations) {                            \
+        for(size_t rcrl_iteration = 0; rcrl_iteration < rcrl_iterations; ++rcrl_iteration) {
+#define RCRL_BENCH_END                                                                                                      \
+    }                                                                                                                       \
+    }, RCRL_BENCH_OPTIMIZED);                                                                                               \
+    RCRL_BENCH_OPTIMIZE_END
+
+// keeps the compiler from optimizing away a value computed in a bench section - rcrl_do_not_optimize(vec.size());
+template <typename T>
+inline void rcrl_do_not_optimize(const T& value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    volatile const void* escaped = &value;
+    (void)escaped;
+#endif
+}
+
+// used for recording the type identity of persistent variables (can't be used directly in RCRL_VAR because of 'name')
+template <typename T>
+const char* rcrl_type_name() {
+    return typeid(T).name();
+}
+
+// the part of the layout of a type which can be computed without reflection - the alignment and a few traits - along
+// with the name and the size it catches most changes of the members of a type but not all of them: reordered members
+// or a member changed to another type with the same size and alignment go unnoticed
+template <typename T>
+constexpr size_t rcrl_type_layout() {
+    return alignof(T) | size_t(std::is_polymorphic<T>::value) << 16 | size_t(std::is_trivially_copyable<T>::value) << 17 |
+           size_t(std::is_standard_layout<T>::value) << 18;
+}
+
 // for variable definitions with persistence in the vars section
 #define RCRL_VAR(alloc_type, final_type, deref, name, ...)                                                                  \
     static RCRL_HANDLE_BRACED_VA_ARGS(final_type)& name = *[]() {                                                           \
-        auto& address = rcrl_get_persistence(#name);                                                                        \
+        auto& address = rcrl_get_persistence(#name, rcrl_type_name<RCRL_HANDLE_BRACED_VA_ARGS(alloc_type)>(),               \
+                                             sizeof(RCRL_HANDLE_BRACED_VA_ARGS(alloc_type)),                                \
+                                             rcrl_type_layout<RCRL_HANDLE_BRACED_VA_ARGS(alloc_type)>());                   \
         if(address == nullptr) {                                                                                            \
             address = (void*)new RCRL_HANDLE_BRACED_VA_ARGS(alloc_type) __VA_ARGS__;                                        \
             rcrl_add_deleter(address, [](void* ptr) { delete static_cast<RCRL_HANDLE_BRACED_VA_ARGS(alloc_type)*>(ptr); }); \
+            rcrl_migrate_persistence(#name, address);                                                                       \
         }                                                                                                                   \
         return deref static_cast<RCRL_HANDLE_BRACED_VA_ARGS(alloc_type)*>(address);                                         \
     }()
@@ -50,6 +112,73 @@
     RCRL_VAR((constness decltype(rcrl_##name##_type_returner())), (constness decltype(*rcrl_##name##_type_returner())), *,  \
              name, __VA_ARGS__)
 
+// RCRL defines this as 0 for the sections compiled before and as 1 for the new ones (the code of a plugin is all of them)
+#ifndef RCRL_NEW_CODE
+#define RCRL_NEW_CODE 1
+#endif // RCRL_NEW_CODE
+
+// the symbols for patchable functions which the host app should export
+// - a slot holds the latest definition of a function (from the plugins which are still loaded)
+// - the slots are keyed by the name and the signature - the same name with different signatures gets different slots
+// - a definition from a new section takes over the slot - the ones from the sections compiled before it don't
+RCRL_SYMBOL_IMPORT std::atomic<void*>* rcrl_get_patch_slot(const char* name, const char* type_name);
+RCRL_SYMBOL_IMPORT void                rcrl_define_patch(const char* name, const char* type_name, void* function,
+                                                         bool new_code);
+
+// the callers of a patchable function - calls the latest definition through the slot in the host
+template <typename F>
+class rcrl_patchable;
+
+template <typename R, typename... Args>
+class rcrl_patchable<R(Args...)>
+{
+    const char*         m_name;
+    std::atomic<void*>* m_slot;
+
+public:
+    explicit rcrl_patchable(const char* name)
+            : m_name(name)
+            , m_slot(rcrl_get_patch_slot(name, rcrl_type_name<R(Args...)>())) {}
+
+    int define(R (*function)(Args...), bool new_code) {
+        rcrl_define_patch(m_name, rcrl_type_name<R(Args...)>(), reinterpret_cast<void*>(function), new_code);
+        return 0;
+    }
+
+    R operator()(Args... args) const {
+        return reinterpret_cast<R (*)(Args...)>(m_slot->load(std::memory_order_acquire))(static_cast<Args&&>(args)...);
+    }
+};
+
+// for a free function in a global section which can be redefined in a later one - all callers (even the code of earlier
+// plugins) call the latest definition through a slot in the host - the cost is one indirect call:
+//     RCRL_PATCHABLE(int, twice, (int x)) { return x * 2; }
+// and later (with the same signature - the return type shouldn't contain commas):
+//     RCRL_PATCH(int, twice, (int x)) { return x + x; }
+// 'twice' is an object with an operator() so it can't be overloaded and its parameters can't have default values
+// the slot doesn't know the namespace - the same name with the same signature in two namespaces would share it so the
+// host rejects a plugin which declares that (the name has to be unique across namespaces for a given signature)
+#define RCRL_PATCHABLE(ret, name, params)                                                                                   \
+    static rcrl_patchable<ret params> name(#name);                                                                          \
+    RCRL_PATCH(ret, name, params)
+#define RCRL_PATCH(ret, name, params) RCRL_PATCH_IMPL(ret, name, params, RCRL_CAT(rcrl_patch_, __COUNTER__))
+#define RCRL_PATCH_IMPL(ret, name, params, impl)                                                                            \
+    static ret impl params;                                                                                                 \
+    static const int RCRL_CAT(impl, _defined) = name.define(&impl, RCRL_NEW_CODE);                                          \
+    static ret impl params
+
 // the symbols for persistence which the host app should export
-RCRL_SYMBOL_IMPORT void*& rcrl_get_persistence(const char* var_name);
+// - the type name, size and layout (see rcrl_type_layout()) of a variable are recorded so redeclaring it with a
+//   different type is detected - a change of the members which none of them reflects isn't
+// - a migration hook registered for a variable name is called (once) with the old and the newly constructed
+//   object when such a redeclaration happens - otherwise the host rejects the plugin instead of reinterpreting the old
+//   object (see rcrl::copy_and_load_new_plugin()) - the once and bench sections after that aren't executed
+RCRL_SYMBOL_IMPORT void*& rcrl_get_persistence(const char* var_name, const char* type_name, size_t type_size,
+                                               size_t type_layout);
 RCRL_SYMBOL_IMPORT void   rcrl_add_deleter(void* address, void (*deleter)(void*));
+RCRL_SYMBOL_IMPORT void   rcrl_add_migration(const char* var_name, void (*migrate)(void* old_address, void* new_address));
+RCRL_SYMBOL_IMPORT void   rcrl_migrate_persistence(const char* var_name, void* new_address);
+RCRL_SYMBOL_IMPORT bool   rcrl_is_load_rejected();
+
+// the symbol for bench sections which the host app should export - runs the body and reports the timings to stdout
+RCRL_SYMBOL_IMPORT int rcrl_run_benchmark(const char* label, void (*body)(size_t iterations), bool optimized);
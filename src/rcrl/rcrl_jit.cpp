@@ -0,0 +1,200 @@
+#include "rcrl_jit.h"
+
+#include <cassert>
+#include <cstdio>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/TextDiagnosticPrinter.h>
+#include <clang/Interpreter/Interpreter.h>
+
+using namespace std;
+
+namespace rcrl
+{
+namespace jit
+{
+// global state
+static unique_ptr<clang::Interpreter>       interpreter;
+static string                               diagnostics;        // filled by the diagnostic printer of the interpreter
+static unique_ptr<llvm::raw_string_ostream> diagnostics_stream; // must outlive the interpreter
+static clang::PartialTranslationUnit*       last_ptu = nullptr; // compiled but not yet executed
+static thread                               compiler_thread;
+static mutex                                status_mut;
+static bool                                 compile_finished = false;
+static int                                  compile_exitcode = 0;
+static thread                               warmup_thread;
+static atomic<bool>                         warmup_done(false);
+
+// the same things the plugin target gets - the precompiled header is force-included there
+static const char* prelude = "#include \"precompiled_for_plugin.h\"\n"
+                             "#include \"rcrl/rcrl_for_plugin.h\"\n";
+
+static bool create_interpreter(function<void(const char*, size_t)>& output) {
+    static bool llvm_initialized = false;
+    if(!llvm_initialized) {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm_initialized = true;
+    }
+
+    vector<const char*> args = {"-std=c++14", "-fno-delayed-template-parsing", "-I" RCRL_JIT_INCLUDE_DIR};
+
+#if LLVM_VERSION_MAJOR >= 17
+    clang::IncrementalCompilerBuilder builder;
+    builder.SetCompilerArgs(args);
+    auto ci = builder.CreateCpp();
+#else  // LLVM_VERSION_MAJOR
+    auto ci = clang::IncrementalCompilerBuilder::create(args);
+#endif // LLVM_VERSION_MAJOR
+    if(!ci) {
+        auto msg = llvm::toString(ci.takeError()) + "\n";
+        output(msg.data(), msg.size());
+        return false;
+    }
+
+    // route diagnostics to a string instead of stderr so they end up in the compiler output
+    diagnostics_stream = unique_ptr<llvm::raw_string_ostream>(new llvm::raw_string_ostream(diagnostics));
+    (*ci)->getDiagnostics().setClient(
+            new clang::TextDiagnosticPrinter(*diagnostics_stream, &(*ci)->getDiagnosticOpts()), true);
+
+    auto interp = clang::Interpreter::create(move(*ci));
+    if(!interp) {
+        auto msg = llvm::toString(interp.takeError()) + "\n";
+        output(msg.data(), msg.size());
+        return false;
+    }
+    interpreter = move(*interp);
+
+    // the prelude is parsed and executed right away - it contains only declarations
+    if(auto err = interpreter->ParseAndExecute(prelude)) {
+        diagnostics_stream->flush();
+        auto msg = diagnostics + llvm::toString(move(err)) + "\n";
+        diagnostics.clear();
+        output(msg.data(), msg.size());
+        interpreter.reset();
+        return false;
+    }
+    return true;
+}
+
+void submit(string code, function<void(const char*, size_t)> output, function<void()> finished) {
+    assert(!is_compiling());
+
+    wait_for_warmup();
+
+    {
+        lock_guard<mutex> lock(status_mut);
+        compile_finished = false;
+    }
+    last_ptu = nullptr;
+
+    compiler_thread = thread([code, output, finished]() mutable {
+        int exitcode = 0;
+        if(!interpreter && !create_interpreter(output)) {
+            exitcode = 1;
+        } else {
+            // on failure the interpreter discards the partial translation unit on its own
+            auto ptu = interpreter->Parse(code);
+            diagnostics_stream->flush();
+            if(!ptu) {
+                diagnostics += llvm::toString(ptu.takeError()) + "\n";
+                exitcode = 1;
+            } else {
+                last_ptu = &*ptu;
+            }
+            if(diagnostics.size())
+                output(diagnostics.data(), diagnostics.size());
+            diagnostics.clear();
+        }
+
+        {
+            lock_guard<mutex> lock(status_mut);
+            compile_exitcode = exitcode;
+            compile_finished = true;
+        }
+        if(finished)
+            finished();
+    });
+}
+
+bool is_compiling() { return compiler_thread.joinable(); }
+
+bool try_get_exit_status(int& exitcode) {
+    if(!compiler_thread.joinable())
+        return false;
+
+    {
+        lock_guard<mutex> lock(status_mut);
+        if(!compile_finished)
+            return false;
+        exitcode = compile_exitcode;
+    }
+    compiler_thread.join();
+    return true;
+}
+
+void cancel() {
+    assert(is_compiling());
+
+    compiler_thread.join();
+#if LLVM_VERSION_MAJOR >= 16
+    if(last_ptu)
+        llvm::consumeError(interpreter->Undo());
+#endif // LLVM_VERSION_MAJOR
+    last_ptu = nullptr;
+}
+
+void execute() {
+    assert(!is_compiling());
+    assert(last_ptu);
+
+    if(auto err = interpreter->Execute(*last_ptu)) {
+        // there is no compiler output at this point - report it as program output
+        fprintf(stderr, "%s\n", llvm::toString(move(err)).c_str());
+    }
+    last_ptu = nullptr;
+}
+
+void warmup() {
+    assert(!is_compiling());
+
+    wait_for_warmup();
+    if(interpreter)
+        return;
+
+    warmup_done   = false;
+    warmup_thread = thread([]() {
+        function<void(const char*, size_t)> discard = [](const char*, size_t) {};
+        create_interpreter(discard);
+        warmup_done = true;
+    });
+}
+
+bool is_warming_up() { return warmup_thread.joinable() && !warmup_done; }
+
+void wait_for_warmup() {
+    if(warmup_thread.joinable())
+        warmup_thread.join();
+}
+
+void reset() {
+    assert(!is_compiling());
+
+    wait_for_warmup();
+
+    last_ptu = nullptr;
+    interpreter.reset();
+    diagnostics_stream.reset();
+    diagnostics.clear();
+}
+} // namespace jit
+} // namespace rcrl
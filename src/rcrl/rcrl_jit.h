@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <functional>
+
+// An in-process backend for RCRL built on top of the clang incremental interpreter (what clang-repl uses) and the ORC JIT.
+// Used by rcrl.cpp instead of spawning the build system when RCRL_JIT is defined - the public API in rcrl.h stays the same.
+// Assumes that the following preprocessor identifiers are defined (done by CMake when LLVM/Clang are found):
+// - RCRL_JIT - enables this backend
+// - RCRL_JIT_INCLUDE_DIR - the folder from which "precompiled_for_plugin.h" and "rcrl/rcrl_for_plugin.h" are included
+
+namespace rcrl
+{
+namespace jit
+{
+// Starts parsing and compiling code as a new incremental translation unit in a background thread:
+// - the interpreter keeps all previous successful submissions so only the new sections should be passed
+// - diagnostics are reported through the output callback
+// - finished is called from the background thread once the compilation is over
+// Shouldn't be called if:
+// - compilation is in progress
+void submit(std::string code, std::function<void(const char*, size_t)> output, std::function<void()> finished);
+
+// Returns true if compilation is in progress
+bool is_compiling();
+
+// Same semantics as rcrl::try_get_exit_status_from_compile()
+bool try_get_exit_status(int& exitcode);
+
+// Waits for the running compilation and discards the translation unit from it (if successful) - with LLVM 16+ only, before
+// that its declarations are kept by the interpreter
+void cancel();
+
+// Runs the static initializers of the last successfully compiled translation unit (the once/vars sections)
+void execute();
+
+// Creates the interpreter and parses the prelude in a background thread - what the first submission would pay for
+void warmup();
+
+// Returns true while the thread started by warmup() is still running
+bool is_warming_up();
+
+// Blocks until the warm-up (if any) is done - clang can't be interrupted so it is simply waited for
+void wait_for_warmup();
+
+// Destroys the interpreter along with all JIT-ed code - a new one is created with the next submission
+void reset();
+} // namespace jit
+} // namespace rcrl
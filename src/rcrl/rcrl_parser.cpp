@@ -134,6 +134,8 @@ vector<Section> parse_sections_and_remove_comments(string& out, Mode default_mod
                     section_starts.push_back({i, line - 1, VARS});
                 if(directive_finder("once"))
                     section_starts.push_back({i, line - 1, ONCE});
+                if(directive_finder("bench"))
+                    section_starts.push_back({i, line - 1, BENCH});
 
                 continue;
             }
@@ -148,6 +150,11 @@ vector<Section> parse_sections_and_remove_comments(string& out, Mode default_mod
     return section_starts;
 }
 
+const char* section_directive(Mode mode) {
+    static const char* directives[] = {"// global\n", "// vars\n", "// once\n", "// bench\n"};
+    return directives[mode];
+}
+
 vector<VariableDefinition> parse_vars(const string& text, size_t line_start) {
     vector<VariableDefinition> out;
 
@@ -235,6 +242,7 @@ vector<VariableDefinition> parse_vars(const string& text, size_t line_start) {
 
                     current_var.name = text.substr(var_name_begin, var_name_len);
                     trim(current_var.name);
+                    current_var.line = line - count(text.begin() + var_name_begin, text.begin() + i, '\n');
                     size_t type_begin = semicolons.size() ? semicolons.back() + 1 : 0;
                     current_var.type  = text.substr(type_begin, var_name_begin - type_begin);
                     trim(current_var.type);
@@ -13,6 +13,7 @@ struct VariableDefinition
     std::string initializer;
     bool        has_assignment = false;
     bool        is_reference   = false;
+    size_t      line           = 0; // the line of the name of the variable
 };
 
 struct Section
@@ -22,9 +23,12 @@ struct Section
     Mode   mode;
 };
 
-// removes comments from the string and returns a list of parsed beginings of sections - one of the 3: global/vars/once
+// removes comments from the string and returns a list of parsed beginings of sections - one of the 4: global/vars/once/bench
 std::vector<Section> parse_sections_and_remove_comments(std::string& out, Mode default_mode);
 
+// the comment which begins a section of the given mode - "// global\n" and so on
+const char* section_directive(Mode mode);
+
 // parses variables from code - for 'vars' sections
 std::vector<VariableDefinition> parse_vars(const std::string& text, size_t line_start = 1);
 
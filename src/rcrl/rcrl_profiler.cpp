@@ -0,0 +1,264 @@
+#include "rcrl_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <vector>
+
+#ifdef __linux__
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <elf.h>
+#include <execinfo.h>
+#include <link.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// older versions of glibc don't name the member for SIGEV_THREAD_ID
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif // sigev_notify_thread_id
+#endif // __linux__
+
+using namespace std;
+
+namespace rcrl
+{
+namespace profiler
+{
+// a call stack from the innermost frame
+struct Sample
+{
+    int   depth = 0;
+    void* frames[64];
+};
+
+// global state
+static vector<Sample>  samples;          // preallocated - the signal handler can't allocate
+static size_t          capacity = 0;     // the size of the buffer for the next call of start() - 0 before the first
+static atomic<size_t>  num_samples(0);   // may exceed samples.size() - those are dropped
+static int             caller_depth = 0; // the frames of the caller of start() and above in each sample
+static double          interval     = 0;
+#ifdef __linux__
+static timer_t          timer;
+static struct sigaction old_action;
+
+static void handler(int, siginfo_t*, void*) {
+    auto index = num_samples++;
+    if(index < samples.size())
+        samples[index].depth = backtrace(samples[index].frames, 64);
+}
+#endif // __linux__
+
+void start(int frequency, double max_seconds) {
+    // a tenth of a second of CPU time at first (a sample is half a KB) - the buffer isn't allocated up front for the
+    // longest load and isn't allocated again for each one
+    if(capacity == 0)
+        capacity = size_t(frequency) / 10;
+    capacity = max<size_t>(min(capacity, size_t(max_seconds * frequency)), 1);
+    samples.resize(capacity);
+    num_samples = 0;
+    interval    = 1.0 / frequency;
+
+#ifdef __linux__
+    // the first call of backtrace() loads libgcc and allocates - which isn't something to do in a signal handler - so it
+    // is called here before the timer is armed
+    void* frames[64];
+    caller_depth = backtrace(frames, 64) - 1;
+
+    struct sigaction action = {};
+    action.sa_sigaction     = handler;
+    action.sa_flags         = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &old_action);
+
+    // the CPU time of this thread only and the signal is delivered to it - not to the threads reading compiler output
+    sigevent event               = {};
+    event.sigev_notify           = SIGEV_THREAD_ID;
+    event.sigev_signo            = SIGPROF;
+    event.sigev_notify_thread_id = int(syscall(SYS_gettid));
+    timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer);
+
+    itimerspec spec          = {};
+    spec.it_interval.tv_nsec = long(1000000000 / frequency);
+    spec.it_value            = spec.it_interval;
+    timer_settime(timer, 0, &spec, nullptr);
+#endif // __linux__
+}
+
+#ifdef __linux__
+// a function symbol from the symbol table of a module - relative to where the module is loaded (unless not relocatable)
+struct Symbol
+{
+    uintptr_t address;
+    size_t    size;
+    string    name;
+    bool operator<(const Symbol& other) const { return address < other.address; }
+};
+
+// reads the function symbols of an ELF file - the full symbol table (if not stripped) has the local functions as well
+static vector<Symbol> read_symbols(const string& path, bool& relocatable) {
+    vector<Symbol> out;
+    ifstream       file(path, ios::binary);
+    string         data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if(data.size() < sizeof(ElfW(Ehdr)))
+        return out;
+
+    auto header = reinterpret_cast<const ElfW(Ehdr)*>(data.data());
+    relocatable = header->e_type == ET_DYN;
+    if(header->e_shoff + header->e_shnum * sizeof(ElfW(Shdr)) > data.size())
+        return out;
+    auto sections = reinterpret_cast<const ElfW(Shdr)*>(data.data() + header->e_shoff);
+    for(int i = 0; i < header->e_shnum; ++i) {
+        if(sections[i].sh_type != SHT_SYMTAB && sections[i].sh_type != SHT_DYNSYM)
+            continue;
+        const auto& strings = sections[sections[i].sh_link];
+        if(sections[i].sh_offset + sections[i].sh_size > data.size() || strings.sh_offset + strings.sh_size > data.size())
+            continue;
+        auto symbols = reinterpret_cast<const ElfW(Sym)*>(data.data() + sections[i].sh_offset);
+        for(size_t k = 0; k < sections[i].sh_size / sizeof(ElfW(Sym)); ++k) {
+            const auto& symbol = symbols[k];
+            if(ELF64_ST_TYPE(symbol.st_info) == STT_FUNC && symbol.st_value && symbol.st_name < strings.sh_size)
+                out.push_back({symbol.st_value, symbol.st_size, data.data() + strings.sh_offset + symbol.st_name});
+        }
+    }
+    sort(out.begin(), out.end());
+    return out;
+}
+
+static string demangle(const char* name) {
+    int   status    = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if(status != 0)
+        return name;
+    string out = demangled;
+    free(demangled);
+    return out;
+}
+
+// the name of the function containing the address - or the name of the module if there is no symbol for it
+static string symbolize(void* address, map<string, pair<bool, vector<Symbol>>>& modules) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%p", address);
+
+    Dl_info info;
+    if(!dladdr(address, &info) || !info.dli_fname)
+        return buffer; // JIT-ed code for example
+
+    auto module = modules.find(info.dli_fname);
+    if(module == modules.end()) {
+        bool relocatable = true;
+        auto symbols     = read_symbols(info.dli_fname, relocatable);
+        module           = modules.insert({info.dli_fname, {relocatable, move(symbols)}}).first;
+    }
+
+    auto  offset  = uintptr_t(address) - (module->second.first ? uintptr_t(info.dli_fbase) : 0);
+    auto& symbols = module->second.second;
+    auto  symbol  = upper_bound(symbols.begin(), symbols.end(), Symbol{offset, 0, ""});
+    if(symbol != symbols.begin() && offset < prev(symbol)->address + max<size_t>(prev(symbol)->size, 1))
+        return demangle(prev(symbol)->name.c_str());
+    if(info.dli_sname)
+        return demangle(info.dli_sname);
+
+    // the offset would split a single function without symbols into as many entries as there are sampled addresses in it
+    string name = info.dli_fname;
+    return name.substr(name.find_last_of('/') + 1);
+}
+
+// the hottest calls first
+static void sort_call_graph(ProfileNode& node) {
+    sort(node.children.begin(), node.children.end(),
+         [](const ProfileNode& lhs, const ProfileNode& rhs) { return lhs.samples > rhs.samples; });
+    for(auto& child : node.children)
+        sort_call_graph(child);
+}
+#endif // __linux__
+
+Profile stop() {
+    Profile profile;
+#ifdef __linux__
+    timer_delete(timer);
+    sigaction(SIGPROF, &old_action, nullptr);
+
+    profile.samples  = min<size_t>(num_samples, samples.size());
+    profile.dropped  = num_samples - profile.samples;
+    profile.interval = interval;
+
+    // the next load gets more room if this one hasn't fit
+    if(profile.dropped)
+        capacity = samples.size() * 2;
+
+    // symbolize each address only once - and resolve the call stacks from the outermost frame
+    map<string, pair<bool, vector<Symbol>>> modules;
+    map<void*, string>                      names;
+    vector<vector<string>>                  stacks;
+    for(size_t i = 0; i < profile.samples; ++i) {
+        // the signal handler and the signal trampoline are the 2 innermost frames - and the frames of the caller of
+        // start() are the outermost ones unless the call stack was too deep for all of it to be recorded
+        int            outermost = samples[i].depth - 1 - (samples[i].depth < 64 ? caller_depth : 0);
+        vector<string> stack;
+        for(int k = outermost; k >= 2; --k) {
+            // return addresses point to the instruction after the call - which might be in the next function
+            auto address = static_cast<char*>(samples[i].frames[k]) - (k > 2 ? 1 : 0);
+            auto name    = names.find(address);
+            if(name == names.end())
+                name = names.insert({address, symbolize(address, modules)}).first;
+            stack.push_back(name->second);
+        }
+        stacks.push_back(move(stack));
+    }
+
+    map<string, ProfileEntry> flat;
+    map<string, size_t>       collapsed;
+    for(const auto& stack : stacks) {
+        if(stack.empty())
+            continue;
+        flat[stack.back()].self++;
+        // recursion shouldn't count a function more than once per sample
+        for(const auto& name : set<string>(stack.begin(), stack.end()))
+            flat[name].total++;
+
+        auto node = &profile.call_graph;
+        node->samples++;
+        string line;
+        for(const auto& name : stack) {
+            auto child = find_if(node->children.begin(), node->children.end(),
+                                 [&](const ProfileNode& other) { return other.name == name; });
+            if(child == node->children.end())
+                child = node->children.insert(node->children.end(), ProfileNode{name, 0, {}});
+            node = &*child;
+            node->samples++;
+            line += (line.size() ? ";" : "") + name;
+        }
+        collapsed[line]++;
+    }
+
+    sort_call_graph(profile.call_graph);
+
+    for(auto& entry : flat) {
+        entry.second.name = entry.first;
+        profile.flat.push_back(entry.second);
+    }
+    sort(profile.flat.begin(), profile.flat.end(),
+         [](const ProfileEntry& lhs, const ProfileEntry& rhs) { return lhs.self > rhs.self; });
+    for(const auto& line : collapsed)
+        profile.collapsed += line.first + " " + to_string(line.second) + "\n";
+#endif // __linux__
+
+    return profile;
+}
+
+void release() {
+    samples.clear();
+    samples.shrink_to_fit();
+    capacity = 0;
+}
+} // namespace profiler
+} // namespace rcrl
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "rcrl.h"
+
+// A sampling profiler used by rcrl.cpp around loading a plugin when profiling is enabled (rcrl::set_profiling()).
+// A CPU time timer of the calling thread raises SIGPROF and the handler records the call stack with backtrace() - the
+// samples are symbolized afterwards with dladdr() and the symbol tables of the loaded modules. Linux only - elsewhere
+// nothing is sampled.
+
+namespace rcrl
+{
+namespace profiler
+{
+// Starts sampling the calling thread with the given frequency (samples per second of CPU time):
+// - the frames of the caller of start() and above are not part of the samples
+// - the buffer for the samples is kept from the last call - it grows (up to max_seconds of CPU time) if the samples from
+//   the last call haven't fit in it
+void start(int frequency, double max_seconds);
+
+// Stops sampling and builds the profile from the samples
+Profile stop();
+
+// Frees the buffer for the samples
+void release();
+} // namespace profiler
+} // namespace rcrl
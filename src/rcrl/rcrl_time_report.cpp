@@ -0,0 +1,388 @@
+#include "rcrl_time_report.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+#ifdef __GNUC__
+#include <cxxabi.h>
+#endif // __GNUC__
+
+using namespace std;
+
+namespace rcrl
+{
+namespace time_report
+{
+// the longest lists of entries in a report
+static const size_t max_entries = 30;
+
+// a JSON value - only as much as needed for the traces from -ftime-trace
+struct Json
+{
+    enum Type
+    {
+        NONE,
+        NUMBER,
+        STRING,
+        ARRAY,
+        OBJECT
+    };
+
+    Type                       type   = NONE;
+    double                     number = 0;
+    string                     str;
+    vector<Json>               items;
+    vector<pair<string, Json>> members;
+
+    const Json* get(const char* key) const {
+        for(const auto& member : members)
+            if(member.first == key)
+                return &member.second;
+        return nullptr;
+    }
+};
+
+// a recursive descent parser which stops at the first malformed value - what has been parsed until then is kept
+class JsonParser
+{
+public:
+    JsonParser(const string& text)
+            : text(text) {}
+
+    bool parse(Json& out) {
+        skip_whitespace();
+        if(pos >= text.size())
+            return false;
+        switch(text[pos]) {
+            case '{': return parse_object(out);
+            case '[': return parse_array(out);
+            case '"': out.type = Json::STRING; return parse_string(out.str);
+            default: return parse_literal(out);
+        }
+    }
+
+private:
+    const string& text;
+    size_t        pos = 0;
+
+    void skip_whitespace() {
+        while(pos < text.size() && isspace(static_cast<unsigned char>(text[pos])))
+            ++pos;
+    }
+
+    bool consume(char c) {
+        skip_whitespace();
+        if(pos >= text.size() || text[pos] != c)
+            return false;
+        ++pos;
+        return true;
+    }
+
+    bool parse_object(Json& out) {
+        out.type = Json::OBJECT;
+        ++pos;
+        if(consume('}'))
+            return true;
+        do {
+            string key;
+            skip_whitespace();
+            if(!parse_string(key) || !consume(':'))
+                return false;
+            out.members.push_back({move(key), Json()});
+            if(!parse(out.members.back().second))
+                return false;
+        } while(consume(','));
+        return consume('}');
+    }
+
+    bool parse_array(Json& out) {
+        out.type = Json::ARRAY;
+        ++pos;
+        if(consume(']'))
+            return true;
+        do {
+            out.items.push_back(Json());
+            if(!parse(out.items.back()))
+                return false;
+        } while(consume(','));
+        return consume(']');
+    }
+
+    bool parse_string(string& out) {
+        if(pos >= text.size() || text[pos] != '"')
+            return false;
+        for(++pos; pos < text.size() && text[pos] != '"'; ++pos) {
+            if(text[pos] != '\\') {
+                out += text[pos];
+                continue;
+            }
+            if(++pos >= text.size())
+                return false;
+            switch(text[pos]) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u': {
+                    // UTF-16 surrogate pairs aren't combined - the names in traces are hardly ever outside of ASCII
+                    auto code = strtoul(text.substr(pos + 1, 4).c_str(), nullptr, 16);
+                    if(code < 0x80) {
+                        out += char(code);
+                    } else if(code < 0x800) {
+                        out += char(0xc0 | (code >> 6));
+                        out += char(0x80 | (code & 0x3f));
+                    } else {
+                        out += char(0xe0 | (code >> 12));
+                        out += char(0x80 | ((code >> 6) & 0x3f));
+                        out += char(0x80 | (code & 0x3f));
+                    }
+                    pos += 4;
+                    break;
+                }
+                default: out += text[pos]; // quotes, slashes
+            }
+        }
+        return pos++ < text.size();
+    }
+
+    // numbers, true, false and null
+    bool parse_literal(Json& out) {
+        auto begin = pos;
+        while(pos < text.size() && (isalnum(static_cast<unsigned char>(text[pos])) || strchr("+-.", text[pos])))
+            ++pos;
+        auto literal = text.substr(begin, pos - begin);
+        if(literal.empty())
+            return false;
+        if(literal != "true" && literal != "false" && literal != "null") {
+            out.type   = Json::NUMBER;
+            out.number = strtod(literal.c_str(), nullptr);
+        }
+        return true;
+    }
+};
+
+static string demangle(const string& name) {
+#ifdef __GNUC__
+    int   status    = 0;
+    char* demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+    if(status == 0) {
+        string out = demangled;
+        free(demangled);
+        return out;
+    }
+#endif // __GNUC__
+    return name;
+}
+
+// the depth of a header in the include tree from a line printed by -H - 0 if the line isn't from -H ("! " and "x " are
+// for valid and invalid precompiled headers - those are reported as depth 1)
+static int get_include_depth(const string& line) {
+    if(line.compare(0, 2, "! ") == 0 || line.compare(0, 2, "x ") == 0)
+        return 1;
+    auto dots = line.find_first_not_of('.');
+    return dots != 0 && dots != string::npos && line[dots] == ' ' ? int(dots) : 0;
+}
+
+// parses a line of the table printed by -ftime-report - " phase parsing : 0.28 ( 68%) 0.18 ( 86%) 0.49 ( 74%) 32M ( 70%)"
+// (older versions put "usr", "sys" and "wall" before the numbers) - returns the name and the wall time
+static bool parse_time_line(const string& line, string& name, double& wall) {
+    auto colon = line.find(" :");
+    if(line.empty() || line[0] != ' ' || colon == string::npos)
+        return false;
+
+    vector<double> times;
+    istringstream  tokens(line.substr(colon + 2));
+    for(string token; tokens >> token;) {
+        // percentages, labels and the memory column - "1576k", "32M" or a plain number of bytes after the times
+        if(token == "(" || token.back() == ')' || token == "usr" || token == "sys" || token == "wall" || token == "ggc")
+            continue;
+        char* end;
+        auto  value = strtod(token.c_str(), &end);
+        if(end == token.c_str() || (*end && !strchr("kMG", *end)))
+            return false;
+        if(!*end && token.find('.') != string::npos)
+            times.push_back(value);
+    }
+    if(times.size() < 3)
+        return false;
+
+    auto begin = line.find_first_not_of(" |");
+    name       = line.substr(begin, line.find_last_not_of(' ', colon) - begin + 1);
+    wall       = times[2];
+    return true;
+}
+
+static bool is_report_line(const string& line) {
+    string name;
+    double wall;
+    // -H also lists the headers without include guards - one path per line after this
+    return get_include_depth(line) || parse_time_line(line, name, wall) || line.compare(0, 13, "Time variable") == 0 ||
+           line == "Multiple include guards may be useful for:" ||
+           (line.size() && line[0] == '/' && line.find_first_of(" :") == string::npos);
+}
+
+string remove_report(const string& output) {
+    string        out;
+    istringstream in(output);
+    for(string line; getline(in, line);)
+        if(!is_report_line(line))
+            out += line + "\n";
+    // keep the lack of a new line at the end
+    if(output.size() && output.back() != '\n' && out.size())
+        out.pop_back();
+    return out;
+}
+
+// adds an entry or adds to the time and the count of an entry with the same name
+static void add(map<string, CompileTimeEntry>& entries, const string& name, double time, size_t count) {
+    auto& entry = entries[name];
+    entry.name  = name;
+    entry.time += time;
+    entry.count += count;
+}
+
+static vector<CompileTimeEntry> sorted(const map<string, CompileTimeEntry>& entries) {
+    vector<CompileTimeEntry> out;
+    for(const auto& entry : entries)
+        out.push_back(entry.second);
+    sort(out.begin(), out.end(), [](const CompileTimeEntry& lhs, const CompileTimeEntry& rhs) {
+        return lhs.time != rhs.time ? lhs.time > rhs.time : lhs.count > rhs.count;
+    });
+    if(out.size() > max_entries)
+        out.resize(max_entries);
+    return out;
+}
+
+// the phases from -ftime-report and the headers from -H - directly included ones weighed by the headers they include
+static void add_gcc_report(const string& output, CompileTimeReport& report, map<string, CompileTimeEntry>& direct) {
+    map<string, CompileTimeEntry> phases;
+    map<string, CompileTimeEntry> headers;
+    string                        current;
+    istringstream                 in(output);
+    for(string line; getline(in, line);) {
+        string name;
+        double wall;
+        if(auto depth = get_include_depth(line)) {
+            if(line[0] == '!' || line[0] == 'x')
+                continue;
+            if(depth == 1) {
+                current = line.substr(2);
+                add(headers, current, 0, 1);
+            } else if(current.size()) {
+                headers[current].count++;
+            }
+        } else if(parse_time_line(line, name, wall) && name != "TOTAL") {
+            add(phases, name, wall, 1);
+            // everything up to and including the deferred parsing of inline functions and templates is the frontend
+            if(name.compare(0, 6, "phase ") == 0)
+                (name == "phase opt and generate" || name == "phase last asm" || name == "phase finalize" ?
+                         report.backend :
+                         report.frontend) += wall;
+        }
+    }
+    report.phases  = sorted(phases);
+    report.headers = sorted(headers);
+    direct         = headers;
+}
+
+// the durations of events in the trace - "Source" events are nested like the headers are
+static void add_clang_report(const string& trace, CompileTimeReport& report, map<string, CompileTimeEntry>& direct) {
+    Json       root;
+    JsonParser parser(trace);
+    parser.parse(root);
+    auto events = root.get("traceEvents");
+    if(!events)
+        return;
+
+    map<string, CompileTimeEntry>              phases, headers, templates, functions;
+    vector<pair<double, pair<double, string>>> sources; // start, duration and path
+    for(const auto& event : events->items) {
+        auto name = event.get("name");
+        auto ph   = event.get("ph");
+        auto ts   = event.get("ts");
+        auto dur  = event.get("dur");
+        if(!name || !ph || ph->str != "X" || !dur)
+            continue;
+        auto args   = event.get("args");
+        auto detail = args ? args->get("detail") : nullptr;
+        auto time   = dur->number / 1e6;
+
+        if(name->str == "Frontend")
+            report.frontend += time;
+        else if(name->str == "Backend")
+            report.backend += time;
+        else if(name->str.compare(0, 6, "Total ") == 0)
+            add(phases, name->str.substr(6), time, args && args->get("count") ? size_t(args->get("count")->number) : 1);
+        else if(!detail)
+            continue;
+        else if(name->str == "Source" && ts)
+            sources.push_back({ts->number, {dur->number, detail->str}});
+        else if(name->str == "InstantiateClass" || name->str == "InstantiateFunction")
+            add(templates, detail->str, time, 1);
+        else if(name->str == "CodeGen Function" || name->str == "OptFunction")
+            add(functions, demangle(detail->str), time, 1);
+    }
+
+    // a header includes the ones which are entered before it is exited - outer ones first when starting together
+    sort(sources.begin(), sources.end(), [](const pair<double, pair<double, string>>& lhs,
+                                            const pair<double, pair<double, string>>& rhs) {
+        return lhs.first != rhs.first ? lhs.first < rhs.first : lhs.second.first > rhs.second.first;
+    });
+    vector<pair<double, string>> stack; // the end and the path of the headers being included
+    for(const auto& source : sources) {
+        while(stack.size() && stack.back().first <= source.first)
+            stack.pop_back();
+        for(const auto& outer : stack)
+            headers[outer.second].count++;
+        add(headers, source.second.second, source.second.first / 1e6, 1);
+        if(stack.empty())
+            add(direct, source.second.second, source.second.first / 1e6, 0);
+        stack.push_back({source.first + source.second.first, source.second.second});
+    }
+    // the counts of the directly included headers include their own includes as well
+    for(auto& entry : direct)
+        entry.second.count = headers[entry.first].count;
+
+    report.phases    = sorted(phases);
+    report.headers   = sorted(headers);
+    report.templates = sorted(templates);
+    report.functions = sorted(functions);
+}
+
+CompileTimeReport build(const string& output, const string& trace, const vector<string>& includes) {
+    CompileTimeReport             report;
+    map<string, CompileTimeEntry> direct; // the headers included by the plugin source
+    if(trace.size())
+        add_clang_report(trace, report, direct);
+    else
+        add_gcc_report(output, report, direct);
+
+    // an include from a global section is compiled again with every submission unless it's in the precompiled header -
+    // worth it for headers which take 5% of the frontend or include 10 headers (when there are no times)
+    map<string, CompileTimeEntry> suggestions;
+    for(const auto& include : includes) {
+        if(include.size() < 3)
+            continue;
+        auto spelling = include.substr(1, include.size() - 2);
+        for(const auto& header : direct) {
+            const auto& path = header.first;
+            if(path != spelling && (path.size() <= spelling.size() ||
+                                    path.compare(path.size() - spelling.size(), spelling.size(), spelling) != 0 ||
+                                    (path[path.size() - spelling.size() - 1] != '/' &&
+                                     path[path.size() - spelling.size() - 1] != '\\')))
+                continue;
+            if(header.second.time > 0.05 * report.frontend || (header.second.time == 0 && header.second.count >= 10))
+                add(suggestions, "#include " + include, header.second.time, header.second.count);
+            break;
+        }
+    }
+    report.pch_suggestions = sorted(suggestions);
+    return report;
+}
+} // namespace time_report
+} // namespace rcrl
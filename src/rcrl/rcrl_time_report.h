@@ -0,0 +1,19 @@
+#pragma once
+
+#include "rcrl.h"
+
+// Builds the compile time reports used by rcrl.cpp when RCRL_TIME_REPORT is defined - from what -ftime-report and -H
+// print (GCC) or from the JSON trace written by -ftime-trace (Clang).
+
+namespace rcrl
+{
+namespace time_report
+{
+// Builds a report from the output of a compilation and the trace from it (empty if there is none):
+// - includes are the #include directives of the global sections as spelled ("<map>", "\"my.h\"") - for the suggestions
+CompileTimeReport build(const std::string& output, const std::string& trace, const std::vector<std::string>& includes);
+
+// Returns the output without the lines printed by -ftime-report and -H - only complete lines should be passed
+std::string remove_report(const std::string& output);
+} // namespace time_report
+} // namespace rcrl
@@ -0,0 +1,277 @@
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "rcrl_watch.h"
+#include "rcrl.h"
+#include "rcrl_parser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <vector>
+
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif // __linux__
+
+using namespace std;
+
+namespace rcrl
+{
+struct WatchedFile
+{
+    string                     path;
+    string                     name;                // without the folder - what inotify reports
+    int                        watch       = -1;    // the inotify watch descriptor of the folder
+    time_t                     mtime       = 0;     // used where inotify isn't available
+    bool                       changed     = true;  // reported by the next poll
+    bool                       has_pending = false; // polled but not yet committed
+    vector<pair<Mode, string>> applied;             // the sections last applied - with comments and whitespace removed
+    vector<pair<Mode, string>> pending;
+    // for each commit - the number of plugins loaded before it and what had been applied before it
+    vector<pair<size_t, vector<pair<Mode, string>>>> commits;
+};
+
+// global state
+static vector<WatchedFile>              watched_files;
+static chrono::steady_clock::time_point last_change;
+static size_t                           undo_count      = 0; // see get_file_watches_undo_count()
+static size_t                           pending_plugins = 0; // loaded before the code from the last poll
+#ifdef __linux__
+static int inotify_fd = -1;
+#endif // __linux__
+
+static time_t get_mtime(const string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? info.st_mtime : 0;
+}
+
+static string trim(const string& str) {
+    auto begin = str.find_first_not_of(" \t\r\n");
+    if(begin == string::npos)
+        return "";
+    return str.substr(begin, str.find_last_not_of(" \t\r\n") - begin + 1);
+}
+
+// splits code into sections - the code of each with its directive and a version without comments for comparisons
+static vector<pair<pair<Mode, string>, string>> split_sections(const string& code) {
+    string stripped = code;
+    auto   sections = parse_sections_and_remove_comments(stripped, ONCE);
+
+    // the offsets at which lines start - sections are reported with the line of their directive
+    vector<size_t> line_starts = {0};
+    for(size_t i = 0; i < code.size(); ++i)
+        if(code[i] == '\n')
+            line_starts.push_back(i + 1);
+
+    vector<pair<pair<Mode, string>, string>> out;
+    for(size_t i = 0; i < sections.size(); ++i) {
+        // the code of a section begins after the new line of its directive and ends where the next directive begins
+        auto begin = sections[i].start_idx + (i > 0 ? 1 : 0);
+        auto end   = i + 1 < sections.size() ? line_starts[sections[i + 1].line - 1] : code.size();
+        if(begin >= end)
+            continue;
+
+        auto key = trim(stripped.substr(begin, end - begin));
+        if(key.empty())
+            continue;
+
+        out.push_back({{sections[i].mode, key}, section_directive(sections[i].mode) + code.substr(begin, end - begin)});
+        if(out.back().second.back() != '\n')
+            out.back().second += '\n';
+    }
+    return out;
+}
+
+// reads the sections of a file - false if it has been removed or is in the middle of being replaced (the next event will
+// bring it back)
+static bool read_sections(const string& path, vector<pair<pair<Mode, string>, string>>& sections) {
+    ifstream in(path, ios::binary);
+    if(!in)
+        return false;
+    sections = split_sections(string(istreambuf_iterator<char>(in), istreambuf_iterator<char>()));
+    return true;
+}
+
+// a global or vars section which has been applied is compiled into every plugin after it - so one which has been changed
+// or removed can't be replaced by submitting the new version on top of it
+static bool replaces_applied_code(const WatchedFile& file, const vector<pair<pair<Mode, string>, string>>& sections) {
+    multiset<pair<Mode, string>> current;
+    for(const auto& section : sections)
+        current.insert(section.first);
+    for(const auto& section : file.applied) {
+        if(section.first != GLOBAL && section.first != VARS)
+            continue;
+        auto it = current.find(section);
+        if(it == current.end())
+            return true;
+        current.erase(it);
+    }
+    return false;
+}
+
+bool watch_file(const string& path) {
+    ifstream in(path);
+    if(!in)
+        return false;
+
+    WatchedFile file;
+    file.path  = path;
+    file.mtime = get_mtime(path);
+
+    auto slash = path.find_last_of("/\\");
+    file.name  = slash == string::npos ? path : path.substr(slash + 1);
+#ifdef __linux__
+    if(inotify_fd == -1)
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotify_fd == -1)
+        return false;
+    // editors often write to a temporary file and rename it - watching the file itself would lose track of it
+    auto folder = slash == string::npos ? string(".") : path.substr(0, slash + 1);
+    file.watch  = inotify_add_watch(inotify_fd, folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if(file.watch == -1)
+        return false;
+#endif // __linux__
+
+    watched_files.push_back(file);
+    // the initial contents are reported right away
+    last_change = chrono::steady_clock::time_point();
+    return true;
+}
+
+void unwatch_files() {
+#ifdef __linux__
+    // closing the descriptor removes all watches
+    if(inotify_fd != -1)
+        close(inotify_fd);
+    inotify_fd = -1;
+#endif // __linux__
+    watched_files.clear();
+}
+
+void reset_file_watches() {
+    for(auto& file : watched_files) {
+        file.applied.clear();
+        file.pending.clear();
+        file.commits.clear();
+        file.has_pending = false;
+        file.changed     = true;
+    }
+    last_change = chrono::steady_clock::time_point();
+}
+
+bool poll_file_watches(string& code, int debounce_ms) {
+    auto now = chrono::steady_clock::now();
+
+#ifdef __linux__
+    if(inotify_fd != -1) {
+        alignas(inotify_event) char buffer[4096];
+        ssize_t                     len;
+        while((len = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+            for(char* ptr = buffer; ptr < buffer + len;) {
+                auto event = reinterpret_cast<const inotify_event*>(ptr);
+                for(auto& file : watched_files) {
+                    if(file.watch == event->wd && event->len && file.name == event->name) {
+                        file.changed = true;
+                        last_change  = now;
+                    }
+                }
+                ptr += sizeof(inotify_event) + event->len;
+            }
+        }
+    }
+#else  // __linux__
+    for(auto& file : watched_files) {
+        auto mtime = get_mtime(file.path);
+        if(mtime != file.mtime) {
+            file.mtime   = mtime;
+            file.changed = true;
+            last_change  = now;
+        }
+    }
+#endif // __linux__
+
+    bool any_changed = false;
+    for(const auto& file : watched_files)
+        any_changed |= file.changed;
+    if(!any_changed || now - last_change < chrono::milliseconds(debounce_ms))
+        return false;
+
+    // the plugins since a file with such changes has first been applied are undone (all of them with the JIT backend) -
+    // the files are rolled back to what they had applied before those plugins and everything after is reported again
+    auto plugin_count = get_plugin_infos().size();
+    auto first_undone = plugin_count + 1;
+    for(const auto& file : watched_files) {
+        vector<pair<pair<Mode, string>, string>> sections;
+        if((file.changed || file.has_pending) && file.commits.size() && read_sections(file.path, sections) &&
+           replaces_applied_code(file, sections))
+            first_undone = min(first_undone, is_jit_backend() ? size_t(0) : file.commits.front().first);
+    }
+    undo_count = 0;
+    if(first_undone <= plugin_count) {
+        undo_count = plugin_count - first_undone;
+        for(auto& file : watched_files) {
+            auto commit = find_if(file.commits.begin(), file.commits.end(),
+                                  [&](const pair<size_t, vector<pair<Mode, string>>>& commit) {
+                                      return commit.first >= first_undone;
+                                  });
+            if(commit != file.commits.end()) {
+                file.applied = move(commit->second);
+                file.commits.erase(commit, file.commits.end());
+                file.changed = true;
+            }
+        }
+    }
+    pending_plugins = plugin_count - undo_count;
+
+    code.clear();
+    for(auto& file : watched_files) {
+        if(!file.changed && !file.has_pending)
+            continue;
+        file.changed = false;
+
+        vector<pair<pair<Mode, string>, string>> sections;
+        if(!read_sections(file.path, sections))
+            continue;
+
+        // sections which are already applied are skipped - each can be matched only once so repeated sections still count
+        multiset<pair<Mode, string>> applied(file.applied.begin(), file.applied.end());
+        file.pending.clear();
+        for(const auto& section : sections) {
+            auto it = applied.find(section.first);
+            if(it != applied.end())
+                applied.erase(it);
+            else
+                code += section.second;
+            file.pending.push_back(section.first);
+        }
+        file.has_pending = true;
+    }
+
+    // nothing but comments or whitespace changed - there is nothing to submit - but applied sections which have only been
+    // removed still have to be undone (the caller commits after that)
+    if(code.empty() && undo_count == 0) {
+        commit_file_watches();
+        return false;
+    }
+    return true;
+}
+
+void commit_file_watches() {
+    for(auto& file : watched_files) {
+        if(file.has_pending) {
+            file.commits.push_back({pending_plugins, move(file.applied)});
+            file.applied     = move(file.pending);
+            file.has_pending = false;
+        }
+    }
+}
+
+size_t get_file_watches_undo_count() { return undo_count; }
+} // namespace rcrl
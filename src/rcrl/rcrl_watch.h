@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+
+// Live reload of files with code edited outside of the host application (in the editor of choice). The watched files are
+// compared section by section with what has last been applied from them so only the changed sections are submitted.
+// Uses inotify on Linux and the modification time of the files on other platforms.
+
+namespace rcrl
+{
+// Starts watching a file with code - sections as in rcrl::submit_code(), the default mode is once:
+// - all of its code is reported by the first call to rcrl::poll_file_watches()
+// - the folder of the file is watched so editors which save by replacing the file are supported
+// - returns false if the file can't be watched
+bool watch_file(const std::string& path);
+
+// Stops watching all files and forgets what has been applied from them
+void unwatch_files();
+
+// Forgets what has been applied from the watched files so they are reported in full again - after rcrl::cleanup_plugins()
+void reset_file_watches();
+
+// Checks the watched files for changes - non-blocking:
+// - returns true (and the code to submit) once the files haven't changed for debounce_ms - rapid saves result in a single
+//   submission
+// - the code consists only of the sections (with their directives) which aren't in what has last been applied - edits in
+//   comments or whitespace don't result in anything
+// - a global or vars section which has been applied is in every plugin after it - if one is changed or removed the
+//   plugins since its file has first been applied have to be undone first (see rcrl::get_file_watches_undo_count())
+//   and the file is reported in full (with any sections of other files applied since then)
+// - also returns true if such sections have only been removed and nothing else is left to submit - the code is empty
+//   then and rcrl::commit_file_watches() should be called right after undoing the plugins
+// - until rcrl::commit_file_watches() is called the same changes are reported again along with any newer ones - so a build
+//   for them can be superseded by a build for a newer version (see rcrl::cancel_compile())
+bool poll_file_watches(std::string& code, int debounce_ms = 100);
+
+// Marks the code from the last rcrl::poll_file_watches() as applied - once it has been compiled and loaded
+void commit_file_watches();
+
+// Returns how many of the last plugins have to be taken back with rcrl::undo() before submitting the code from the last
+// rcrl::poll_file_watches() which has returned true - 0 if it can be compiled on top of them. With the JIT backend it is
+// either 0 or all of them (use rcrl::cleanup_plugins() then)
+size_t get_file_watches_undo_count();
+} // namespace rcrl
@@ -2,6 +2,13 @@
 #include "doctest/doctest/doctest.h"
 
 #include "../src/rcrl/rcrl.h"
+#include "../src/rcrl/rcrl_watch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 
 TEST_CASE("single variables") {
 	int exitcode = 0;
@@ -17,7 +24,347 @@ TEST_CASE("single variables") {
 	rcrl::copy_and_load_new_plugin();
 }
 
-#ifndef __APPLE__
+TEST_CASE("backend") {
+#ifdef RCRL_JIT
+	CHECK(rcrl::is_jit_backend());
+#else  // RCRL_JIT
+	CHECK_FALSE(rcrl::is_jit_backend());
+#endif // RCRL_JIT
+}
+
+TEST_CASE("warm-up") {
+	int exitcode = 0;
+
+	// submitting while the warm-up is running cancels it
+	rcrl::start_warmup();
+	rcrl::submit_code("int warm = 1;", rcrl::VARS);
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	REQUIRE_FALSE(rcrl::is_warming_up());
+	rcrl::copy_and_load_new_plugin();
+
+	// a finished warm-up doesn't affect the next submission
+	rcrl::start_warmup(false);
+	while(rcrl::is_warming_up());
+	REQUIRE_FALSE(rcrl::is_compiling());
+	rcrl::submit_code("warm++;", rcrl::ONCE);
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+}
+
+// speculation, undo and unloading aren't supported by the JIT backend - see rcrl::is_jit_backend()
+#ifndef RCRL_JIT
+TEST_CASE("speculative compilation") {
+	int exitcode = 0;
+
+	// unparsable code isn't compiled speculatively
+	REQUIRE_FALSE(rcrl::speculate_code("int (5);", rcrl::VARS));
+
+	// the speculative build for the same code is adopted by the submission
+	REQUIRE(rcrl::speculate_code("int spec = 5;", rcrl::VARS));
+	REQUIRE_FALSE(rcrl::is_compiling());
+	rcrl::submit_code("int spec = 5;", rcrl::VARS);
+	REQUIRE(rcrl::is_compiling());
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+
+	// a speculative build for different code is discarded
+	REQUIRE(rcrl::speculate_code("spec = 6;"));
+	rcrl::submit_code("spec++;");
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+
+	// the build of the next code is started while loading the current plugin
+	rcrl::submit_code("int spec_next = spec;", rcrl::VARS);
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::speculate_code_after_load("spec_next++;");
+	rcrl::copy_and_load_new_plugin();
+	rcrl::submit_code("spec_next++;");
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+}
+#endif // RCRL_JIT
+
+TEST_CASE("plugin infos") {
+	int exitcode = 0;
+
+	rcrl::cleanup_plugins();
+	REQUIRE(rcrl::get_plugin_infos().size() == 0);
+
+	for(int i = 0; i < 2; ++i) {
+		rcrl::submit_code("int info_" + std::to_string(i) + " = 0;", rcrl::VARS);
+		while(!rcrl::try_get_exit_status_from_compile(exitcode));
+		REQUIRE_FALSE(exitcode);
+		rcrl::copy_and_load_new_plugin();
+	}
+
+	auto infos = rcrl::get_plugin_infos();
+	REQUIRE(infos.size() == 2);
+	CHECK(infos[0].name != infos[1].name);
+	CHECK(infos[1].load_time > 0);
+#ifndef RCRL_JIT
+	CHECK(infos[1].file_size > 0);
+#ifdef __linux__
+	CHECK(infos[1].mapped_size > 0);
+#endif // __linux__
+#endif // RCRL_JIT
+
+	rcrl::cleanup_plugins();
+	REQUIRE(rcrl::get_plugin_infos().size() == 0);
+}
+
+// loading a plugin shouldn't cost more with each plugin loaded before it - a benchmark of as many builds as there are
+// plugins which depends on the load of the machine so it is skipped unless RCRL_LOAD_TIME_PLUGINS is set (to 1000)
+TEST_CASE("load time with many plugins" * doctest::skip(getenv("RCRL_LOAD_TIME_PLUGINS") == nullptr)) {
+	int  exitcode = 0;
+	auto count    = size_t(atoi(getenv("RCRL_LOAD_TIME_PLUGINS")));
+	REQUIRE(count >= 10);
+
+	rcrl::cleanup_plugins();
+	for(size_t i = 0; i < count; ++i) {
+		rcrl::submit_code("int load_time = " + std::to_string(i) + "; (void)load_time;");
+		while(!rcrl::try_get_exit_status_from_compile(exitcode));
+		REQUIRE_FALSE(exitcode);
+		rcrl::copy_and_load_new_plugin();
+	}
+
+	// the median of the first and of the last tenth of them
+	auto infos  = rcrl::get_plugin_infos();
+	auto median = [&](size_t first) {
+		std::vector<double> times;
+		for(size_t i = first; i < first + count / 10; ++i)
+			times.push_back(infos[i].load_time);
+		std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+		return times[times.size() / 2];
+	};
+	auto first = median(0);
+	auto last  = median(count - count / 10);
+	printf("load time of %d plugins - %.3f ms for the first tenth, %.3f ms for the last\n", int(count), first * 1000,
+	       last * 1000);
+	// dlopen() itself gets slower with each loaded object (by ~0.4 us with glibc 2.36 - it walks the list of them) - anything
+	// more than that per plugin loaded before (with some room for noise) is on the side of rcrl
+	CHECK(last < first * 2 + count * 0.000001);
+
+	rcrl::cleanup_plugins();
+}
+
+TEST_CASE("var infos") {
+	int exitcode = 0;
+
+	rcrl::cleanup_plugins();
+	rcrl::submit_code("// global\n#include <vector>\n// vars\nstd::vector<int> accounted(100000);");
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+
+	rcrl::submit_code("int accounted_2 = 0;", rcrl::VARS);
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+
+	// sorted by name
+	auto vars = rcrl::get_var_infos();
+	REQUIRE(vars.size() == 2);
+	CHECK(vars[0].name == "accounted");
+	CHECK(vars[0].size == sizeof(std::vector<int>));
+	CHECK(vars[0].plugin == 0);
+	CHECK(vars[1].size == sizeof(int));
+	CHECK(vars[1].plugin == 1);
+
+	auto infos = rcrl::get_plugin_infos();
+	REQUIRE(infos.size() == 2);
+	CHECK(infos[0].num_vars == 1);
+	CHECK(infos[0].vars_size == sizeof(std::vector<int>));
+	CHECK(infos[1].num_vars == 1);
+#ifdef __GLIBC__
+	CHECK(vars[0].heap_size >= 100000 * sizeof(int));
+	CHECK(infos[0].vars_heap_size == vars[0].heap_size);
+	CHECK(infos[0].heap_growth >= vars[0].heap_size);
+#endif // __GLIBC__
+
+	rcrl::cleanup_plugins();
+	CHECK(rcrl::get_var_infos().empty());
+}
+
+#ifndef RCRL_JIT
+TEST_CASE("undo") {
+	int exitcode = 0;
+	auto compile_and_load = [&](const std::string& code, rcrl::Mode mode) {
+		rcrl::submit_code(code, mode);
+		while(!rcrl::try_get_exit_status_from_compile(exitcode));
+		REQUIRE_FALSE(exitcode);
+		rcrl::copy_and_load_new_plugin();
+	};
+
+	rcrl::cleanup_plugins();
+	compile_and_load("int kept = 1;", rcrl::VARS);
+	compile_and_load("int undone = 2;\n// global\nint undone_function() { return undone; }", rcrl::VARS);
+	compile_and_load("undone = undone_function() + kept;", rcrl::ONCE);
+
+	rcrl::undo(2);
+	REQUIRE(rcrl::get_plugin_infos().size() == 1);
+	auto vars = rcrl::get_var_infos();
+	REQUIRE(vars.size() == 1);
+	CHECK(vars[0].name == "kept");
+
+	// the undone definitions aren't a part of the code compiled after that
+	rcrl::submit_code("undone = 3;", rcrl::ONCE);
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	CHECK(exitcode);
+	rcrl::get_new_compiler_output();
+
+	// so they can be defined again - even with a different type
+	compile_and_load("double undone = kept;", rcrl::VARS);
+	CHECK(rcrl::get_var_infos().size() == 2);
+	CHECK(rcrl::get_plugin_infos().size() == 2);
+
+	rcrl::cleanup_plugins();
+}
+#endif // RCRL_JIT
+
+TEST_CASE("cancelling a compilation") {
+	int exitcode = 0;
+
+	rcrl::submit_code("int cancelled = 5;", rcrl::VARS);
+	rcrl::cancel_compile();
+	REQUIRE_FALSE(rcrl::is_compiling());
+
+	// the discarded variable doesn't exist
+	rcrl::submit_code("int cancelled = 6;", rcrl::VARS);
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+
+	rcrl::cleanup_plugins();
+}
+
+TEST_CASE("compiler output in pieces") {
+	int exitcode = 0;
+
+	rcrl::submit_code("int pieces = undeclared_1 + undeclared_2;", rcrl::VARS);
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE(exitcode);
+
+	// whole lines only - a piece is longer than the limit only if it is a single line
+	std::string all;
+	for(auto piece = rcrl::get_new_compiler_output(64); piece.size(); piece = rcrl::get_new_compiler_output(64)) {
+		CHECK(piece.back() == '\n');
+		CHECK((piece.size() <= 64 || piece.find('\n') == piece.size() - 1));
+		all += piece;
+	}
+	CHECK(all.find("undeclared_2") != std::string::npos);
+}
+
+TEST_CASE("batch submission") {
+	int exitcode = 0;
+
+	// a single plugin - the once sections and the vars initializers are executed in the order of the snippets
+	REQUIRE(rcrl::submit_batch({{"#include <cstdlib>", rcrl::GLOBAL, ""},
+	                            {"int batch = 1;", rcrl::VARS, ""},
+	                            {"batch *= 10;", rcrl::ONCE, ""},
+	                            {"// vars\nint batch_2 = batch + 1;\n// once\nif(batch_2 != 11) abort();", rcrl::ONCE, ""}}));
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+
+	// compiler errors are attributed to the snippets
+	REQUIRE(rcrl::submit_batch({{"batch++;", rcrl::ONCE, ""}, {"\nbatch_undefined++;", rcrl::ONCE, "bad"}}));
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE(exitcode);
+	auto results = rcrl::get_batch_results();
+	REQUIRE(results.size() == 2);
+	CHECK(results[0].name == "snippet_1");
+	CHECK_FALSE(results[0].has_errors);
+	CHECK(results[1].name == "bad");
+	CHECK(results[1].has_errors);
+	CHECK(results[1].diagnostics.find("bad:2:") != std::string::npos);
+
+	// so are parse errors
+	REQUIRE_FALSE(rcrl::submit_batch({{"int (5);", rcrl::VARS, ""}, {"batch++;", rcrl::ONCE, ""}}));
+	results = rcrl::get_batch_results();
+	REQUIRE(results.size() == 2);
+	CHECK(results[0].has_errors);
+	CHECK_FALSE(results[1].has_errors);
+
+	// errors in code submitted after a batch still refer to the plugin source
+	rcrl::get_new_compiler_output();
+	rcrl::submit_code("batch_undefined++;");
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE(exitcode);
+	CHECK(rcrl::get_new_compiler_output().find("snippet_") == std::string::npos);
+
+	// a warning which mentions an error (or the quoted line of code under it) isn't one - neither is what a once section
+	// prints when the plugin is loaded
+#ifndef _MSC_VER
+	REQUIRE(rcrl::submit_batch({{"#include <cstdio>", rcrl::GLOBAL, "prints_include"},
+	                            {"\n#warning not an error\nprintf(\"error\\n\");", rcrl::ONCE, "prints"}}));
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	results = rcrl::get_batch_results();
+	REQUIRE(results.size() == 2);
+	CHECK(results[1].diagnostics.find("prints:2:") != std::string::npos);
+	CHECK(results[1].diagnostics.find("warning") != std::string::npos);
+	CHECK_FALSE(results[1].has_errors);
+	rcrl::copy_and_load_new_plugin();
+	CHECK_FALSE(rcrl::get_batch_results()[1].has_errors);
+#endif // _MSC_VER
+
+	rcrl::cleanup_plugins();
+}
+
+TEST_CASE("diagnostics refer to the submitted code") {
+	int exitcode = 0;
+
+	rcrl::cleanup_plugins();
+	rcrl::submit_code("int diag = 0;", rcrl::VARS);
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+
+	rcrl::get_new_compiler_output();
+	rcrl::submit_code("// vars\nint diag_2 = 0;\n\nint diag_3 = diag_undefined;\n// once\ndiag++;\ndiag_undefined++;\n");
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE(exitcode);
+	auto output = rcrl::get_new_compiler_output();
+	CHECK(output.find("submission 2, vars section 1, line 4:") != std::string::npos);
+	CHECK(output.find("submission 2, once section 2, line 7:") != std::string::npos);
+
+	rcrl::cleanup_plugins();
+}
+
+TEST_CASE("bench sections") {
+	int exitcode = 0;
+
+	rcrl::BenchOptions options;
+	options.warmup_time = 0.001;
+	options.min_time    = 0.001;
+	options.repetitions = 3;
+	rcrl::set_bench_options(options);
+
+	// the body runs in a loop - warm-up, calibration and the repetitions
+	rcrl::submit_code("// global\n#include <cstdlib>\n// vars\nint benched = 0;\n"
+	                  "// bench\nbenched++;\nrcrl_do_not_optimize(benched);\n"
+	                  "// once\nif(benched < 3) abort();");
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+
+	// bench sections aren't executed again by the next plugins - like once sections
+	for(auto code : {"benched = -1;", "if(benched != -1) abort();"}) {
+		rcrl::submit_code(code);
+		while(!rcrl::try_get_exit_status_from_compile(exitcode));
+		REQUIRE_FALSE(exitcode);
+		rcrl::copy_and_load_new_plugin();
+	}
+
+	rcrl::set_bench_options(rcrl::BenchOptions());
+	rcrl::cleanup_plugins();
+}
 
 #ifdef _WIN32
 #define RCRL_SYMBOL_EXPORT __declspec(dllexport)
@@ -25,6 +372,285 @@ TEST_CASE("single variables") {
 #define RCRL_SYMBOL_EXPORT __attribute__((visibility("default")))
 #endif
 
+static int g_watched_value = 0;
+RCRL_SYMBOL_EXPORT void test_watched_value(int value) { g_watched_value = value; }
+
+TEST_CASE("file watches") {
+	std::string path = RCRL_BUILD_FOLDER "/watched.rcrl";
+	auto write = [&](const char* code) { std::ofstream(path) << code; };
+	std::string code;
+
+	write("// vars\nint w = 1;\n// once\nw++;\n");
+	REQUIRE(rcrl::watch_file(path));
+	REQUIRE(rcrl::poll_file_watches(code, 0));
+	CHECK(code == "// vars\nint w = 1;\n// once\nw++;\n");
+	rcrl::commit_file_watches();
+	CHECK_FALSE(rcrl::poll_file_watches(code, 0));
+
+	// only the changed section is reported - changes in comments are ignored
+	write("// vars\nint w = 1; // a comment\n// once\nw += 2;\n");
+	REQUIRE(rcrl::poll_file_watches(code, 0));
+	CHECK(code == "// once\nw += 2;\n");
+
+	// without a commit the next poll reports the changes since the last one as well
+	write("// vars\nint w = 1;\nint w2 = 0;\n// once\nw += 2;\n");
+	REQUIRE(rcrl::poll_file_watches(code, 0));
+	CHECK(code == "// vars\nint w = 1;\nint w2 = 0;\n// once\nw += 2;\n");
+	rcrl::commit_file_watches();
+
+	// rapid changes are reported once the debounce time has passed
+	write("// once\nw2++;\n");
+	CHECK_FALSE(rcrl::poll_file_watches(code, 100000));
+
+	rcrl::unwatch_files();
+
+#ifndef __APPLE__
+	int  exitcode = 0;
+	auto apply    = [&]() {
+		REQUIRE(rcrl::poll_file_watches(code, 0));
+		if(rcrl::get_file_watches_undo_count() && rcrl::is_jit_backend())
+			rcrl::cleanup_plugins();
+		else if(rcrl::get_file_watches_undo_count())
+			rcrl::undo(rcrl::get_file_watches_undo_count());
+		if(code.size()) {
+			REQUIRE(rcrl::submit_code(code));
+			while(!rcrl::try_get_exit_status_from_compile(exitcode));
+			REQUIRE_FALSE(exitcode);
+			rcrl::copy_and_load_new_plugin();
+		}
+		rcrl::commit_file_watches();
+	};
+
+	rcrl::cleanup_plugins();
+	write("// global\nRCRL_SYMBOL_IMPORT void test_watched_value(int);\nint watched_f() { return 1; }\n// vars\n"
+	      "int watched_v = watched_f();\n// once\ntest_watched_value(watched_f() + watched_v * 10);\n");
+	REQUIRE(rcrl::watch_file(path));
+	apply();
+	CHECK(g_watched_value == 11);
+
+	// an edited global function can't be compiled on top of the old one - the plugin is undone and the file applied again
+	write("// global\nRCRL_SYMBOL_IMPORT void test_watched_value(int);\nint watched_f() { return 2; }\n// vars\n"
+	      "int watched_v = watched_f();\n// once\ntest_watched_value(watched_f() + watched_v * 10);\n");
+	apply();
+	CHECK(g_watched_value == 22);
+	CHECK(rcrl::get_plugin_infos().size() == 1);
+
+	// while a once section is compiled on top of it
+	write("// global\nRCRL_SYMBOL_IMPORT void test_watched_value(int);\nint watched_f() { return 2; }\n// vars\n"
+	      "int watched_v = watched_f();\n// once\ntest_watched_value(watched_f() + watched_v * 100);\n");
+	apply();
+	CHECK(rcrl::get_file_watches_undo_count() == 0);
+	CHECK(g_watched_value == 202);
+	CHECK(rcrl::get_plugin_infos().size() == 2);
+
+	// removing the global and vars sections leaves nothing to submit - the plugins with them are still undone
+	write("// once\n// nothing left\n");
+	apply();
+	CHECK(code.empty());
+	CHECK(rcrl::get_plugin_infos().size() == 0);
+	CHECK_FALSE(rcrl::poll_file_watches(code, 0));
+
+	rcrl::unwatch_files();
+	rcrl::cleanup_plugins();
+#endif // __APPLE__
+	std::remove(path.c_str());
+}
+
+#ifdef RCRL_TIME_REPORT
+TEST_CASE("compile time report") {
+	int exitcode = 0;
+	std::string output;
+
+	rcrl::submit_code("// global\n#include <map>\n#include <string>\n// once\nstd::map<int, std::string> m; m[1] = \"a\";");
+	while(!rcrl::try_get_exit_status_from_compile(exitcode))
+		output += rcrl::get_new_compiler_output();
+	output += rcrl::get_new_compiler_output();
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+
+	auto report = rcrl::get_last_compile_time_report();
+	CHECK(report.frontend > 0);
+	CHECK(report.phases.size() > 0);
+	CHECK(report.headers.size() > 0);
+	// the test plugin has no precompiled header so the standard headers are worth moving into one
+	bool suggested = false;
+	for(const auto& suggestion : report.pch_suggestions)
+		suggested |= suggestion.name == "#include <map>";
+	CHECK(suggested);
+	// what -ftime-report and -H print isn't shown as compiler output
+	CHECK(output.find("phase parsing") == std::string::npos);
+	CHECK(output.find(". /") == std::string::npos);
+
+	rcrl::cleanup_plugins();
+}
+#endif // RCRL_TIME_REPORT
+
+#ifdef __linux__
+#ifndef RCRL_JIT
+TEST_CASE("unloading once-only plugins") {
+	int exitcode = 0;
+	auto compile_and_load = [&](const std::string& code) {
+		rcrl::submit_code(code);
+		while(!rcrl::try_get_exit_status_from_compile(exitcode));
+		REQUIRE_FALSE(exitcode);
+		rcrl::copy_and_load_new_plugin();
+		return rcrl::get_plugin_infos().back();
+	};
+
+	rcrl::set_unload_once_only_plugins(true);
+
+	// the test plugin has no precompiled header
+	auto vars = "// global\n#include <functional>\n#include <vector>\n#include <cstdlib>\n// vars\nstd::function<int()> "
+	            "unload_f;\nstd::vector<std::function<int()>> unload_fs;\nstd::vector<const char*> unload_names;";
+	CHECK(compile_and_load(vars).unloaded == false);
+	CHECK(compile_and_load("// once\nint a = 5; (void)a;").unloaded == true);
+	// the lambda from this plugin escapes into a persistent variable
+	CHECK(compile_and_load("// once\nunload_f = []() { return 42; };").unloaded == false);
+	CHECK(compile_and_load("// once\nif(unload_f() != 42) abort();").unloaded == true);
+
+	auto infos = rcrl::get_plugin_infos();
+	REQUIRE(infos.size() == 4);
+	CHECK(infos[1].name != infos[3].name);
+
+	// the lambda and the string literal escape into heap memory owned by persistent variables
+	CHECK(compile_and_load("// once\nunload_fs.push_back([]() { return 7; });").unloaded == false);
+	CHECK(compile_and_load("// once\nif(unload_fs.back()() != 7) abort();").unloaded == true);
+	CHECK(compile_and_load("// once\nunload_names.push_back(\"literal\");").unloaded == false);
+	// the hook would be called after the plugin is gone
+	CHECK(compile_and_load("// once\nrcrl_add_migration(\"unload_f\", [](void*, void*) {});").unloaded == false);
+
+	rcrl::cleanup_plugins();
+	rcrl::set_unload_once_only_plugins(false);
+}
+#endif // RCRL_JIT
+
+static int barrier_calls = 0;
+
+TEST_CASE("plugin barrier") {
+	int exitcode = 0;
+
+	rcrl::set_plugin_barrier([]() { barrier_calls++; });
+
+	// called after the code of the plugin has been executed - before it is unloaded
+	rcrl::set_unload_once_only_plugins(!rcrl::is_jit_backend());
+	rcrl::submit_code("// once\nint b = 5; (void)b;");
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+	CHECK(barrier_calls == 1);
+	CHECK(rcrl::get_plugin_infos().back().unloaded == !rcrl::is_jit_backend());
+	rcrl::set_unload_once_only_plugins(false);
+
+	// and before the deleters of the persistent variables are called
+	rcrl::cleanup_plugins();
+	CHECK(barrier_calls == 2);
+
+	rcrl::set_plugin_barrier(nullptr);
+}
+
+static std::atomic<int> notifications(0);
+
+TEST_CASE("output notifier") {
+	int exitcode = 0;
+
+	rcrl::set_output_notifier([]() { notifications++; });
+
+	// the exit of the build is notified even if it hasn't printed anything
+	rcrl::submit_code("int notified = 1;", rcrl::VARS);
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	CHECK(notifications > 0);
+	rcrl::copy_and_load_new_plugin();
+
+	rcrl::set_output_notifier(nullptr);
+}
+
+static int checkpointed_state = 0;
+
+TEST_CASE("checkpoint and rollback") {
+	int exitcode = 0;
+
+	rcrl::cleanup_plugins();
+	rcrl::submit_code("int checkpointed = 1;", rcrl::VARS);
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+	checkpointed_state = 1;
+
+	// the rest of the tests run in the copy which has been rolled back to
+	auto resumed = rcrl::checkpoint();
+	REQUIRE(resumed >= 0);
+	if(resumed == 0) {
+		REQUIRE(rcrl::get_checkpoint_count() == 1);
+		checkpointed_state = 2;
+		rcrl::submit_code("int rolled_back = 2;", rcrl::VARS);
+		while(!rcrl::try_get_exit_status_from_compile(exitcode));
+		REQUIRE_FALSE(exitcode);
+		rcrl::copy_and_load_new_plugin();
+
+		// the output of this isn't taken before the rollback
+		rcrl::submit_code("undeclared_before_rollback();");
+		while(!rcrl::try_get_exit_status_from_compile(exitcode));
+		REQUIRE(exitcode);
+		rcrl::rollback(7);
+	}
+
+	CHECK(resumed == 7);
+	CHECK(checkpointed_state == 1);
+	CHECK(rcrl::get_plugin_infos().size() == 1);
+	CHECK(rcrl::get_var_infos().size() == 1);
+	CHECK(rcrl::get_new_compiler_output().find("undeclared_before_rollback") != std::string::npos);
+
+	// the plugins from before the checkpoint are still usable
+	rcrl::submit_code("checkpointed++;");
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+	rcrl::cleanup_plugins();
+}
+
+TEST_CASE("profiling") {
+	int exitcode = 0;
+
+	rcrl::set_profiling(true, 1000);
+
+	// enough CPU time for a few dozen samples
+	rcrl::submit_code("// global\n#include <chrono>\n"
+	                  "void profiled_loop() {\n"
+	                  "    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);\n"
+	                  "    while(std::chrono::steady_clock::now() < end);\n"
+	                  "}\n"
+	                  "// once\nprofiled_loop();");
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+
+	auto profile = rcrl::get_last_profile();
+	CHECK(profile.samples > 0);
+	CHECK(profile.call_graph.samples == profile.samples);
+	CHECK(profile.collapsed.find("profiled_loop()") != std::string::npos);
+	bool found = false;
+	for(const auto& entry : profile.flat)
+		found |= entry.name == "profiled_loop()" && entry.total > 0;
+	CHECK(found);
+
+	// the samples which don't fit under the cap for the buffer are dropped - and counted
+	rcrl::set_profiling(true, 1000, 0.02);
+	rcrl::submit_code("profiled_loop();");
+	while(!rcrl::try_get_exit_status_from_compile(exitcode));
+	REQUIRE_FALSE(exitcode);
+	rcrl::copy_and_load_new_plugin();
+	profile = rcrl::get_last_profile();
+	CHECK(profile.samples <= 20);
+	CHECK(profile.dropped > 0);
+
+	rcrl::set_profiling(false);
+	rcrl::cleanup_plugins();
+}
+#endif // __linux__
+
+#ifndef __APPLE__
+
 std::vector<int> g_pushed_ints;
 RCRL_SYMBOL_EXPORT void test_ctor_dtor_order(int num) { g_pushed_ints.push_back(num); }
 
@@ -64,4 +690,153 @@ S a2;
 	REQUIRE(g_pushed_ints[3] == 1);
 }
 
+static std::vector<int> g_patched_results;
+RCRL_SYMBOL_EXPORT void test_patched_result(int result) { g_patched_results.push_back(result); }
+
+TEST_CASE("patchable functions") {
+	int exitcode = 0;
+	auto compile_and_load = [&](const std::string& code, rcrl::Mode mode) {
+		rcrl::submit_code(code, mode);
+		while(!rcrl::try_get_exit_status_from_compile(exitcode));
+		REQUIRE_FALSE(exitcode);
+		rcrl::copy_and_load_new_plugin();
+	};
+
+	rcrl::cleanup_plugins();
+	g_patched_results.clear();
+
+	// the caller from the first plugin is kept in a variable so the later calls go through its code
+	compile_and_load(R"raw(
+RCRL_SYMBOL_IMPORT void test_patched_result(int);
+RCRL_PATCHABLE(int, patched, (int x)) { return x * 2; }
+int call_patched(int x) { return patched(x); }
+// vars
+auto first_caller = call_patched;
+)raw", rcrl::GLOBAL);
+	compile_and_load("test_patched_result(first_caller(5));", rcrl::ONCE);
+	compile_and_load("RCRL_PATCH(int, patched, (int x)) { return x * 3; }\n// once\ntest_patched_result(first_caller(5));",
+	                 rcrl::GLOBAL);
+	// a plugin compiled after the patch calls it as well (it defines both again)
+	compile_and_load("test_patched_result(first_caller(5));", rcrl::ONCE);
+
+	// the previous definition is back once the patch is undone
+#ifndef RCRL_JIT
+	rcrl::undo(2);
+	compile_and_load("test_patched_result(first_caller(5));", rcrl::ONCE);
+#endif // RCRL_JIT
+
+	rcrl::cleanup_plugins();
+
+	REQUIRE(g_patched_results.size() == (rcrl::is_jit_backend() ? 3 : 4));
+	CHECK(g_patched_results[0] == 10);
+	CHECK(g_patched_results[1] == 15);
+	CHECK(g_patched_results[2] == 15);
+	CHECK((rcrl::is_jit_backend() || g_patched_results[3] == 10));
+
+	// the same name with different signatures in 2 namespaces gets 2 slots - patching one doesn't touch the other
+	g_patched_results.clear();
+	compile_and_load(R"raw(
+RCRL_SYMBOL_IMPORT void test_patched_result(int);
+namespace first { RCRL_PATCHABLE(int, twin, (int x)) { return x + 1; } }
+namespace second { RCRL_PATCHABLE(double, twin, (double x)) { return x * 0.5; } }
+)raw", rcrl::GLOBAL);
+	compile_and_load("test_patched_result(first::twin(1));\ntest_patched_result(int(second::twin(8)));", rcrl::ONCE);
+	compile_and_load("namespace second { RCRL_PATCH(double, twin, (double x)) { return x * 0.25; } }\n// once\n"
+	                 "test_patched_result(first::twin(1));\ntest_patched_result(int(second::twin(8)));",
+	                 rcrl::GLOBAL);
+
+	REQUIRE(g_patched_results.size() == 4);
+	CHECK(g_patched_results[0] == 2);
+	CHECK(g_patched_results[1] == 4);
+	CHECK(g_patched_results[2] == 2);
+	CHECK(g_patched_results[3] == 2);
+
+	// with the same signature they would share a slot - the plugin is rejected
+#ifndef RCRL_JIT
+	auto num_plugins = rcrl::get_plugin_infos().size();
+	compile_and_load("namespace third { RCRL_PATCHABLE(int, twin, (int x)) { return x - 1; } }", rcrl::GLOBAL);
+	CHECK(rcrl::get_last_load_error().find("'twin'") != std::string::npos);
+	CHECK(rcrl::get_last_load_error().find("declared more than once") != std::string::npos);
+	CHECK(rcrl::get_plugin_infos().size() == num_plugins);
+
+	// and the slot still calls the definition from the first namespace
+	compile_and_load("test_patched_result(first::twin(1));", rcrl::ONCE);
+	CHECK(rcrl::get_last_load_error() == "");
+	REQUIRE(g_patched_results.size() == 5);
+	CHECK(g_patched_results[4] == 2);
+#endif // RCRL_JIT
+
+	rcrl::cleanup_plugins();
+}
+
+// the interpreter keeps the declarations of the JIT backend - the type of a variable can't change there
+#ifndef RCRL_JIT
+static int g_migrated_value = 0;
+RCRL_SYMBOL_EXPORT void test_migrated_value(int value) { g_migrated_value = value; }
+
+TEST_CASE("persistence type migration") {
+	int exitcode = 0;
+	auto compile_and_load = [&](const std::string& code, rcrl::Mode mode) {
+		rcrl::submit_code(code, mode);
+		while(!rcrl::try_get_exit_status_from_compile(exitcode));
+		REQUIRE_FALSE(exitcode);
+		rcrl::copy_and_load_new_plugin();
+	};
+	// the type of the variable comes from a header which is edited between the submissions
+	auto write_header = [](const char* members) {
+		std::ofstream(RCRL_BUILD_FOLDER "/migrated_type.h") << "#pragma once\nstruct Migrated { " << members << " };\n";
+	};
+
+	rcrl::cleanup_plugins();
+	write_header("int value;");
+	compile_and_load("#include \"" RCRL_BUILD_FOLDER "/migrated_type.h\"\n"
+	                 "RCRL_SYMBOL_IMPORT void test_migrated_value(int);\n"
+	                 "// vars\nMigrated migrated = {42};",
+	                 rcrl::GLOBAL);
+	// the hook is compiled against the old type - the new one starts with the same member
+	compile_and_load("rcrl_add_migration(\"migrated\", [](void* old_address, void* new_address) {\n"
+	                 "    *static_cast<int*>(new_address) = static_cast<Migrated*>(old_address)->value + 1;\n"
+	                 "});",
+	                 rcrl::ONCE);
+
+	write_header("int value; double scale;");
+	compile_and_load("test_migrated_value(migrated.value);", rcrl::ONCE);
+	CHECK(rcrl::get_last_load_error() == "");
+	CHECK(g_migrated_value == 43);
+	REQUIRE(rcrl::get_var_infos().size() == 1);
+	CHECK(rcrl::get_var_infos()[0].size > sizeof(int));
+
+	// the hook is used only once - another change of the type rejects the plugin and the old object is kept - its once
+	// section isn't executed
+	auto num_plugins = rcrl::get_plugin_infos().size();
+	write_header("int value; double scale; int extra;");
+	g_migrated_value = 0;
+	compile_and_load("test_migrated_value(migrated.value);", rcrl::ONCE);
+	CHECK(rcrl::get_last_load_error().find("'migrated' redeclared with a different type") != std::string::npos);
+	CHECK(rcrl::get_plugin_infos().size() == num_plugins);
+	CHECK(g_migrated_value == 0);
+
+	write_header("int value; double scale;");
+	g_migrated_value = 0;
+	compile_and_load("test_migrated_value(migrated.value);", rcrl::ONCE);
+	CHECK(rcrl::get_last_load_error() == "");
+	CHECK(g_migrated_value == 43);
+
+	// a type with the same name and size but another alignment is a different type as well
+	rcrl::cleanup_plugins();
+	write_header("int value; int scale;");
+	compile_and_load("#include \"" RCRL_BUILD_FOLDER "/migrated_type.h\"\n"
+	                 "RCRL_SYMBOL_IMPORT void test_migrated_value(int);\n"
+	                 "// vars\nMigrated migrated = {42};",
+	                 rcrl::GLOBAL);
+	num_plugins = rcrl::get_plugin_infos().size();
+	write_header("double value;");
+	compile_and_load("test_migrated_value(1);", rcrl::ONCE);
+	CHECK(rcrl::get_last_load_error().find("8 bytes, alignment 4") != std::string::npos);
+	CHECK(rcrl::get_last_load_error().find("8 bytes, alignment 8") != std::string::npos);
+	CHECK(rcrl::get_plugin_infos().size() == num_plugins);
+
+	rcrl::cleanup_plugins();
+}
+#endif // RCRL_JIT
 #endif
@@ -30,8 +30,22 @@ vec
 ;)raw",
                  "std::vector\n<int>", "vec", "{\n}", true, false);
 
+	auto multiple = rcrl::parse_vars("int a = 5;\n\nint\nb;", 3);
+	REQUIRE(multiple.size() == 2);
+	CHECK(multiple[0].line == 3);
+	CHECK(multiple[1].line == 6);
+
 	CHECK_THROWS(rcrl::parse_vars("int a(5)")); // no semicolon
 	CHECK_THROWS(rcrl::parse_vars("int a((5);")); // brace mismatch
 	CHECK_THROWS(rcrl::parse_vars("int (5);")); // no name
 	CHECK_THROWS(rcrl::parse_vars("a = 5;")); // no name 2
 }
+
+TEST_CASE("sections") {
+	std::string code     = "// global\nint f();\n// bench\nf();\n";
+	auto        sections = rcrl::parse_sections_and_remove_comments(code, rcrl::ONCE);
+	REQUIRE(sections.size() == 3);
+	CHECK(sections[1].mode == rcrl::GLOBAL);
+	CHECK(sections[2].mode == rcrl::BENCH);
+	CHECK(sections[2].line == 3);
+}